@@ -0,0 +1,427 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "Numa.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+enum : size_t { HUGE_PAGE_SIZE = 2 << 20 };
+
+// 2 MB aligned region preferring memory of node. Takes a hugetlbfs page when
+// some are reserved, otherwise asks for a transparent huge page.
+inline void* HugePageAlloc(size_t node)
+{
+#ifdef MAP_HUGETLB
+    void* addr(mmap(nullptr, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0));
+    if (addr != MAP_FAILED)
+    {
+        NumaBind(addr, HUGE_PAGE_SIZE, node);
+        return addr;
+    }
+#endif
+    char* const raw(static_cast<char*>(mmap(nullptr, 2 * HUGE_PAGE_SIZE,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)));
+    if (raw == MAP_FAILED)
+    {
+        fprintf(stderr, "HugePageAlloc() mmap failed\n");
+        return nullptr;
+    }
+    char* const aligned(raw + (HUGE_PAGE_SIZE
+        - reinterpret_cast<uintptr_t>(raw) % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE);
+    if (aligned != raw)
+    {
+        munmap(raw, aligned - raw);
+    }
+    munmap(aligned + HUGE_PAGE_SIZE, raw + HUGE_PAGE_SIZE - aligned);
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+#endif
+    NumaBind(aligned, HUGE_PAGE_SIZE, node);
+    return aligned;
+}
+
+// Fixed size blocks carved from 2 MB huge page chunks, one chunk per thread
+// and NUMA node at a time. Every block remembers its home node and goes back
+// to that node's free list when released, so memory freed by a thread on the
+// other socket is reused locally. Chunks are kept until the process exits.
+template<size_t SIZE, size_t ALIGN = alignof(std::max_align_t)>
+class alignas(void*) SlabArena
+{
+private:
+    static_assert(SIZE >= sizeof(void*), "SlabArena blocks hold a free link");
+
+    enum : size_t
+    {
+        BLOCK_ALIGN = ALIGN > alignof(size_t) ? ALIGN : alignof(size_t)
+    };
+
+    struct alignas(BLOCK_ALIGN) Header
+    {
+        size_t node_;
+    };
+
+    struct alignas(64) Shared
+    {
+        std::atomic<void*> head_;
+    };
+
+    enum : size_t
+    {
+        STRIDE = sizeof(Header)
+            + (SIZE + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN,
+        CHUNK_SIZE = HUGE_PAGE_SIZE,
+        LOCAL_MAX = 256
+    };
+
+    enum : unsigned char { CACHE_UNUSED, CACHE_LIVE, CACHE_DEAD };
+
+    struct Cache
+    {
+        size_t node_;
+        void* free_;
+        void* released_;
+        void* releasedTail_;
+        size_t releasedCount_;
+        char* bump_;
+        char* end_;
+
+        Cache()
+            : node_(NumaTopology::CurrentNode() % NUMA_MAX_NODES),
+            free_(nullptr),
+            released_(nullptr),
+            releasedTail_(nullptr),
+            releasedCount_(0),
+            bump_(nullptr),
+            end_(nullptr)
+        {
+        }
+        ~Cache()
+        {
+            ReleaseChunk(*this);
+            if (free_)
+            {
+                void* last(free_);
+                while (NextOf(last))
+                {
+                    last = NextOf(last);
+                }
+                PushShared(node_, free_, last);
+                free_ = nullptr;
+            }
+            Flush(*this);
+        }
+    };
+
+    struct LocalCache : Cache
+    {
+        LocalCache()
+        {
+            State() = CACHE_LIVE;
+        }
+        ~LocalCache()
+        {
+            State() = CACHE_DEAD;
+        }
+    };
+
+    Shared shared_[NUMA_MAX_NODES];
+
+    static SlabArena& Instance()
+    {
+        static SlabArena arena;
+        return arena;
+    }
+
+    // Trivially destructible, so it can still be read by thread_local
+    // destructors running after the thread's Cache is gone, such as a
+    // hazard pointer owner created before the first allocation.
+    static unsigned char& State()
+    {
+        static thread_local unsigned char state(CACHE_UNUSED);
+        return state;
+    }
+
+    // The calling thread's Cache, or nullptr once it has been destroyed.
+    static Cache* Local()
+    {
+        if (State() == CACHE_DEAD)
+        {
+            return nullptr;
+        }
+        static thread_local LocalCache cache;
+        return &cache;
+    }
+
+    static void*& NextOf(void* block)
+    {
+        return *static_cast<void**>(block);
+    }
+
+    static void PushShared(size_t node, void* first, void* last)
+    {
+        std::atomic<void*>& head(Instance().shared_[node].head_);
+        void* old(head.load(std::memory_order_relaxed));
+        do
+        {
+            NextOf(last) = old;
+        } while (!head.compare_exchange_weak(old, first,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    static void Flush(Cache& cache)
+    {
+        if (cache.released_)
+        {
+            PushShared(cache.node_, cache.released_, cache.releasedTail_);
+        }
+        cache.released_ = nullptr;
+        cache.releasedTail_ = nullptr;
+        cache.releasedCount_ = 0;
+    }
+
+    static void* Carve(Cache& cache, void* next)
+    {
+        Header* header(reinterpret_cast<Header*>(cache.bump_));
+        header->node_ = cache.node_;
+        cache.bump_ += STRIDE;
+        void* block(header + 1);
+        NextOf(block) = next;
+        return block;
+    }
+
+    // Carves what is left of the current chunk onto its node's shared list,
+    // so a thread leaving the chunk behind does not leak it.
+    static void ReleaseChunk(Cache& cache)
+    {
+        void* first(nullptr);
+        void* last(nullptr);
+        while (cache.bump_ && cache.bump_ + STRIDE <= cache.end_)
+        {
+            first = Carve(cache, first);
+            if (!last)
+            {
+                last = first;
+            }
+        }
+        if (first)
+        {
+            PushShared(cache.node_, first, last);
+        }
+        cache.bump_ = nullptr;
+        cache.end_ = nullptr;
+    }
+
+    static void* Refill(Cache& cache)
+    {
+        const size_t node(NumaTopology::CurrentNode() % NUMA_MAX_NODES);
+        if (node != cache.node_)
+        {
+            Flush(cache);
+            ReleaseChunk(cache);
+            cache.node_ = node;
+        }
+        void* head(Instance().shared_[node].head_.exchange(
+            nullptr, std::memory_order_acquire));
+        if (head)
+        {
+            return head;
+        }
+        if (!cache.bump_ || cache.bump_ + STRIDE > cache.end_)
+        {
+            cache.bump_ = static_cast<char*>(HugePageAlloc(node));
+            if (!cache.bump_)
+            {
+                cache.end_ = nullptr;
+                return nullptr;
+            }
+            cache.end_ = cache.bump_ + CHUNK_SIZE;
+        }
+        return Carve(cache, nullptr);
+    }
+
+    static void* Allocate(Cache& cache)
+    {
+        void* block(cache.released_);
+        if (block)
+        {
+            cache.released_ = NextOf(block);
+            if (!cache.released_)
+            {
+                cache.releasedTail_ = nullptr;
+            }
+            --cache.releasedCount_;
+            return block;
+        }
+        if (!cache.free_)
+        {
+            cache.free_ = Refill(cache);
+        }
+        block = cache.free_;
+        if (block)
+        {
+            cache.free_ = NextOf(block);
+        }
+        return block;
+    }
+
+public:
+    // Past the thread's Cache, a one-off Cache on the stack takes the
+    // block and hands everything else back to the shared lists.
+    static void* Allocate()
+    {
+        Cache* const local(Local());
+        if (!local)
+        {
+            Cache cache;
+            return Allocate(cache);
+        }
+        return Allocate(*local);
+    }
+
+    static void Release(void* block)
+    {
+        if (!block)
+        {
+            return;
+        }
+        const size_t node(HomeNode(block));
+        Cache* const cache(Local());
+        if (!cache || node != cache->node_)
+        {
+            PushShared(node, block, block);
+            return;
+        }
+        NextOf(block) = cache->released_;
+        if (!cache->released_)
+        {
+            cache->releasedTail_ = block;
+        }
+        cache->released_ = block;
+        if (++cache->releasedCount_ >= LOCAL_MAX)
+        {
+            Flush(*cache);
+        }
+    }
+
+    static size_t HomeNode(const void* block)
+    {
+        return (static_cast<const Header*>(block) - 1)->node_;
+    }
+};
+
+// Stateless std allocator over SlabArena. Single objects come from the
+// arena packed at alignof(T), so a 16 byte node takes 24 bytes with its
+// header; arrays fall back to the global heap.
+template<typename T>
+class ArenaAllocator
+{
+    static_assert(alignof(T) <= alignof(std::max_align_t),
+        "ArenaAllocator blocks are only max_align_t aligned");
+
+public:
+    using value_type = T;
+
+    ArenaAllocator() {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        if (n != 1)
+        {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        void* block(SlabArena<sizeof(T), alignof(T)>::Allocate());
+        if (!block)
+        {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(block);
+    }
+
+    void deallocate(T* ptr, size_t n)
+    {
+        if (n != 1)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+        SlabArena<sizeof(T), alignof(T)>::Release(ptr);
+    }
+
+    static size_t HomeNode(const T* ptr)
+    {
+        return SlabArena<sizeof(T), alignof(T)>::HomeNode(ptr);
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const ArenaAllocator<T>&, const ArenaAllocator<U>&)
+{
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const ArenaAllocator<T>&, const ArenaAllocator<U>&)
+{
+    return false;
+}
+
+#endif
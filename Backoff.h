@@ -0,0 +1,170 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Contention managers for the MsQueue CAS loops. A loop builds one per
+// operation, calls onFailure() after every failed CAS and onSuccess() once
+// the operation is done.
+
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+// Per thread xorshift, so backing off threads do not retry in lockstep.
+inline uint32_t BackoffJitter()
+{
+    static thread_local uint32_t state(static_cast<uint32_t>(
+        reinterpret_cast<uintptr_t>(&state) >> 4) | 1);
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+struct NoBackoff
+{
+    void onFailure() {}
+    void onSuccess() {}
+};
+
+struct PauseBackoff
+{
+    void onFailure()
+    {
+        CpuRelax();
+    }
+    void onSuccess() {}
+};
+
+// Spins a random number of pauses below a limit that doubles on every
+// failure of the same operation, from MIN up to MAX.
+template<size_t MIN = 4, size_t MAX = 1024>
+class ExponentialBackoff
+{
+private:
+    size_t limit_;
+
+public:
+    ExponentialBackoff()
+        : limit_(MIN)
+    {
+    }
+
+    void onFailure()
+    {
+        for (size_t spins(BackoffJitter() % limit_ + 1); spins; --spins)
+        {
+            CpuRelax();
+        }
+        limit_ = limit_ * 2 < MAX ? limit_ * 2 : MAX;
+    }
+
+    void onSuccess() {}
+};
+
+// Exponential backoff whose starting limit follows the thread's recent
+// failure rate, a moving average of failed CASes per operation kept in
+// sixteenths, so threads on a contended queue back off from the first
+// failure while uncontended ones barely wait.
+template<size_t MIN = 4, size_t MAX = 1024>
+class AdaptiveBackoff
+{
+private:
+    uint32_t failures_;
+
+    static uint32_t& Rate()
+    {
+        static thread_local uint32_t rate(0);
+        return rate;
+    }
+
+public:
+    AdaptiveBackoff()
+        : failures_(0)
+    {
+    }
+
+    void onFailure()
+    {
+        size_t limit(MIN * (1 + Rate() / 16));
+        for (uint32_t i = 0; i < failures_ && limit < MAX; ++i)
+        {
+            limit *= 2;
+        }
+        limit = limit < MAX ? limit : MAX;
+        ++failures_;
+        for (size_t spins(BackoffJitter() % limit + 1); spins; --spins)
+        {
+            CpuRelax();
+        }
+    }
+
+    void onSuccess()
+    {
+        uint32_t& rate(Rate());
+        rate = rate - rate / 8 + failures_ * 2;
+    }
+};
+
+#endif
@@ -0,0 +1,354 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BROADCAST_QUEUE_H
+#define BROADCAST_QUEUE_H
+
+#include "Node.h"
+#include "HazardPointer.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+// Multicast log: publishers append to one shared MsQueue and every
+// Subscriber walks it with its own cursor, so a publish costs one node no
+// matter how many subscribers there are. Nodes behind the slowest cursor
+// are freed by reclaim(), which publishers run every GC_NUM pushes. A
+// thread keeps separate push counts for up to PUSH_SLOTS queues of a type.
+template<typename T, size_t MAX_THREADS, size_t MAX_SUBSCRIBERS,
+    size_t GC_NUM = 64, typename Allocator = std::allocator<T> >
+class alignas(void*) BroadcastQueue
+    : private QueueHazardPointerIndex
+{
+public:
+    using Node = node_type::NodeWithHazardPointer<T>;
+    using NodeAllocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Node>;
+
+private:
+    enum : uint64_t { FREE_SLOT = UINT64_MAX };
+    enum : size_t { PUSH_SLOTS = 8 };
+
+    using Hp = QueueHazardPointerOwner<
+        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+    using Hps = HazardPointersSingleton<
+        Node, MAX_THREADS * 2, NodeAllocator>;
+
+    struct alignas(64) Cursor
+    {
+        std::atomic<uint64_t> position_;
+    };
+
+    struct PushCount
+    {
+        uint64_t owner_;
+        size_t pushes_;
+    };
+
+    MsQueue<Node, NodeAllocator> queue_;
+    Cursor cursors_[MAX_SUBSCRIBERS];
+    std::atomic_flag reclaiming_;
+    uint64_t headPosition_;
+    const uint64_t id_;
+
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counts the calling thread's pushes to this queue. A slot taken over
+    // from another queue reclaims right away, so queues sharing a slot
+    // reclaim more often rather than never.
+    bool reclaimDue() const
+    {
+        static thread_local PushCount counts[PUSH_SLOTS] = {};
+        PushCount& count(counts[id_ % PUSH_SLOTS]);
+        if (count.owner_ != id_)
+        {
+            count.owner_ = id_;
+            count.pushes_ = 0;
+            return true;
+        }
+        if (++count.pushes_ < GC_NUM)
+        {
+            return false;
+        }
+        count.pushes_ = 0;
+        return true;
+    }
+
+    void lock()
+    {
+        while (reclaiming_.test_and_set(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock()
+    {
+        reclaiming_.clear(std::memory_order_release);
+    }
+
+    void reclaimLocked()
+    {
+        uint64_t slowest(FREE_SLOT);
+        for (const auto& cursor : cursors_)
+        {
+            slowest = std::min(slowest,
+                cursor.position_.load(std::memory_order_acquire));
+        }
+        Node* const first(queue_.head_.load(std::memory_order_relaxed));
+        Node* head(first);
+        while (headPosition_ < slowest
+            && head != queue_.tail_.load(std::memory_order_acquire))
+        {
+            Node* const next(head->next_.load(std::memory_order_acquire));
+            if (!next)
+            {
+                break;
+            }
+            head = next;
+            ++headPosition_;
+        }
+        if (head == first)
+        {
+            return;
+        }
+        queue_.head_.store(head, std::memory_order_release);
+        AsymmetricFence::Heavy();
+        HazardSnapshot<const Node*>& hazards(Hazards());
+        Hps::Instance().snapshot(hazards);
+        for (Node* node(first); node != head;)
+        {
+            Node* const next(node->next_.load(std::memory_order_relaxed));
+            if (hazards.covers(node))
+            {
+                Hp::ReclaimLater(node);
+            }
+            else
+            {
+                Reclaim<Node, NodeAllocator>(node);
+            }
+            node = next;
+        }
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static HazardSnapshot<const Node*>& Hazards()
+    {
+        static thread_local HazardSnapshot<const Node*> hazards;
+        return hazards;
+    }
+
+    void enqueue(Node* newNode)
+    {
+        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        queue_.push(hazardTail, newNode, GetNextNode<Node>);
+        hazardTail.store(nullptr, std::memory_order_release);
+        if (reclaimDue())
+        {
+            reclaim();
+        }
+    }
+
+public:
+    class alignas(void*) Subscriber
+    {
+    private:
+        BroadcastQueue& queue_;
+        Cursor* cursor_;
+        Node* node_;
+        uint64_t position_;
+
+    public:
+        explicit Subscriber(const Subscriber&) = delete;
+        const Subscriber& operator=(const Subscriber&) = delete;
+
+        // Sees every element published after the constructor returns.
+        explicit Subscriber(BroadcastQueue& queue)
+            : queue_(queue),
+            cursor_(nullptr),
+            node_(nullptr),
+            position_(0)
+        {
+            queue_.lock();
+            node_ = queue_.queue_.head_.load(std::memory_order_relaxed);
+            position_ = queue_.headPosition_;
+            for (Node* next(node_->next_.load(std::memory_order_acquire));
+                next; next = node_->next_.load(std::memory_order_acquire))
+            {
+                node_ = next;
+                ++position_;
+            }
+            for (auto& cursor : queue_.cursors_)
+            {
+                if (cursor.position_.load(std::memory_order_relaxed)
+                    == FREE_SLOT)
+                {
+                    cursor.position_.store(position_,
+                        std::memory_order_release);
+                    cursor_ = &cursor;
+                    break;
+                }
+            }
+            queue_.unlock();
+            if (!cursor_)
+            {
+                fprintf(stderr, "BroadcastQueue get cursor failed\n");
+            }
+        }
+
+        ~Subscriber()
+        {
+            if (cursor_)
+            {
+                cursor_->position_.store(FREE_SLOT,
+                    std::memory_order_release);
+            }
+        }
+
+        constexpr bool isValid() const
+        {
+            return cursor_ != nullptr;
+        }
+
+        template<typename Reader>
+        bool popWith(const Reader& reader)
+        {
+            if (!cursor_)
+            {
+                return false;
+            }
+            Node* const next(node_->next_.load(std::memory_order_acquire));
+            if (!next)
+            {
+                return false;
+            }
+            reader(static_cast<const T&>(next->data_));
+            node_ = next;
+            cursor_->position_.store(++position_,
+                std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T& value)
+        {
+            return popWith([&value](const T& data) { value = data; });
+        }
+    };
+
+    explicit BroadcastQueue(const BroadcastQueue&) = delete;
+    const BroadcastQueue& operator=(const BroadcastQueue&) = delete;
+
+    BroadcastQueue()
+        : queue_(),
+        cursors_(),
+        headPosition_(0),
+        id_(NextId())
+    {
+        reclaiming_.clear();
+        for (auto& cursor : cursors_)
+        {
+            cursor.position_.store(FREE_SLOT, std::memory_order_relaxed);
+        }
+    }
+
+    ~BroadcastQueue()
+    {
+        Node* head(queue_.head_.load(std::memory_order_relaxed));
+        while (head)
+        {
+            Node* tmp(head);
+            head = head->next_.load(std::memory_order_relaxed);
+            Reclaim<Node, NodeAllocator>(tmp);
+        }
+    }
+
+    bool push(const T& value)
+    {
+        enqueue(NewNode<Node, NodeAllocator>(value));
+        return true;
+    }
+
+    bool push(T&& value)
+    {
+        enqueue(NewNode<Node, NodeAllocator>(std::move(value)));
+        return true;
+    }
+
+    // Frees the nodes every subscriber has passed; returns at once when
+    // another thread is already reclaiming.
+    void reclaim()
+    {
+        if (reclaiming_.test_and_set(std::memory_order_acquire))
+        {
+            return;
+        }
+        reclaimLocked();
+        unlock();
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        Hp::ReclaimHazardNodes();
+    }
+};
+
+#endif
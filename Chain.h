@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef CHAIN_H
 #define CHAIN_H
 
+#include <cstdio>
 #include <memory>
 #include <type_traits>
 
@@ -197,6 +198,22 @@ public:
         tail_->next_.store(node, std::memory_order_relaxed);
         tail_ = tail_->next_.load(std::memory_order_relaxed);
     }
+    void splice(NodeType* first, NodeType* last)
+    {
+        if (!first)
+        {
+            return;
+        }
+        if (tail_)
+        {
+            tail_->next_.store(first, std::memory_order_relaxed);
+        }
+        else
+        {
+            head_ = first;
+        }
+        tail_ = last;
+    }
     void pushFront(NodeType* node)
     {
         node->next_.store(head_, std::memory_order_relaxed);
@@ -0,0 +1,236 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef COUNTER_H
+#define COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Sequence number of the calling thread, used to pick its stripe.
+inline size_t ThreadStripe()
+{
+    static std::atomic<size_t> next(0);
+    static thread_local const size_t index(
+        next.fetch_add(1, std::memory_order_relaxed));
+    return index;
+}
+
+// Counter split over cache line padded stripes. Each thread always adds to
+// the same stripe, so add() never bounces a line between writers; sum()
+// reads every stripe and is only exact when the counter is quiescent.
+template<size_t STRIPES = 16>
+class alignas(64) StripedCounter
+{
+private:
+    struct alignas(64) Stripe
+    {
+        std::atomic<int64_t> value_;
+    };
+
+    Stripe stripes_[STRIPES];
+
+    static size_t Index()
+    {
+        return ThreadStripe() % STRIPES;
+    }
+
+public:
+    explicit StripedCounter(const StripedCounter&) = delete;
+    const StripedCounter& operator=(const StripedCounter&) = delete;
+
+    StripedCounter()
+        : stripes_()
+    {
+    }
+
+    void add(int64_t delta)
+    {
+        stripes_[Index()].value_.fetch_add(delta,
+            std::memory_order_relaxed);
+    }
+
+    int64_t sum() const
+    {
+        int64_t total(0);
+        for (const auto& stripe : stripes_)
+        {
+            total += stripe.value_.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+};
+
+// Fixed number of credits handed out in batches. A thread takes credits
+// from its own stripe and only goes to the shared pool once per batch;
+// consumers give credits back to their stripe and return full batches to
+// the pool. When the pool runs dry every stripe is swept into it before
+// refusing, so credits parked on idle stripes are never lost. Credits
+// taken unconditionally by take() may leave the pool in debt.
+template<size_t STRIPES = 16>
+class alignas(64) CreditPool
+{
+private:
+    struct alignas(64) Stripe
+    {
+        std::atomic<int64_t> value_;
+    };
+
+    Stripe stripes_[STRIPES];
+    alignas(64) std::atomic<int64_t> shared_;
+    const int64_t batch_;
+
+    std::atomic<int64_t>& local()
+    {
+        return stripes_[ThreadStripe() % STRIPES].value_;
+    }
+
+    void collect()
+    {
+        int64_t total(0);
+        for (auto& stripe : stripes_)
+        {
+            total += stripe.value_.exchange(0, std::memory_order_relaxed);
+        }
+        if (total)
+        {
+            shared_.fetch_add(total, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    explicit CreditPool(const CreditPool&) = delete;
+    const CreditPool& operator=(const CreditPool&) = delete;
+
+    explicit CreditPool(int64_t credits)
+        : stripes_(),
+        shared_(credits),
+        batch_(credits / (2 * STRIPES) > 64 ? 64
+            : credits / (2 * STRIPES) + 1)
+    {
+    }
+
+    // Takes count credits if there are enough. admit() is asked before
+    // every refill from the pool and may veto it.
+    template<typename Admit>
+    bool acquire(int64_t count, const Admit& admit)
+    {
+        std::atomic<int64_t>& stripe(local());
+        if (stripe.fetch_sub(count, std::memory_order_relaxed) >= count)
+        {
+            return true;
+        }
+        stripe.fetch_add(count, std::memory_order_relaxed);
+        bool collected(false);
+        int64_t shared(shared_.load(std::memory_order_relaxed));
+        for (;;)
+        {
+            if (shared >= count)
+            {
+                if (!admit())
+                {
+                    return false;
+                }
+                const int64_t grant(shared < count + batch_
+                    ? shared : count + batch_);
+                if (shared_.compare_exchange_weak(shared, shared - grant,
+                    std::memory_order_relaxed))
+                {
+                    stripe.fetch_add(grant - count,
+                        std::memory_order_relaxed);
+                    return true;
+                }
+                continue;
+            }
+            if (collected)
+            {
+                return false;
+            }
+            collect();
+            collected = true;
+            shared = shared_.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool acquire(int64_t count)
+    {
+        return acquire(count, []() { return true; });
+    }
+
+    void take(int64_t count)
+    {
+        std::atomic<int64_t>& stripe(local());
+        if (stripe.fetch_sub(count, std::memory_order_relaxed) < count)
+        {
+            stripe.fetch_add(count, std::memory_order_relaxed);
+            shared_.fetch_sub(count, std::memory_order_relaxed);
+        }
+    }
+
+    void release(int64_t count)
+    {
+        if (shared_.load(std::memory_order_relaxed) < 0)
+        {
+            shared_.fetch_add(count, std::memory_order_relaxed);
+            return;
+        }
+        std::atomic<int64_t>& stripe(local());
+        if (stripe.fetch_add(count, std::memory_order_relaxed) + count
+            > 2 * batch_)
+        {
+            stripe.fetch_sub(batch_, std::memory_order_relaxed);
+            shared_.fetch_add(batch_, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,415 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DELAY_QUEUE_H
+#define DELAY_QUEUE_H
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Delayed delivery on a four level hashed timer wheel with 256 slots per
+// level. Timers live in a fixed pool and are named by handles carrying a
+// generation, so cancel() is a single CAS that is safe after the timer has
+// fired. Producers only push onto a lock-free inbox; the wheel itself is
+// driven by whichever thread wins advance(), which moves due elements into
+// the ready LockFreeQueue that pop() reads from. Cancelled timers go onto
+// a second inbox, and the next advance() unlinks them from the doubly
+// linked wheel slots and returns them to the pool.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Allocator = std::allocator<T> >
+class alignas(void*) DelayQueue
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Handle = uint64_t;
+
+private:
+    enum : uint64_t { PENDING = 1, CANCELLED = 2, FIRED = 3 };
+    enum : size_t { LEVELS = 4, SLOT_BITS = 8, SLOTS = 1 << SLOT_BITS };
+
+    struct Timer
+    {
+        T data_;
+        uint64_t deadline_;
+        std::atomic<uint32_t> next_;
+        std::atomic<uint32_t> cancelNext_;
+        uint32_t prev_;
+        uint32_t slot_;
+        std::atomic<uint64_t> state_;
+    };
+
+    LockFreeQueue<T, MAX_THREADS, GC_NUM, Allocator> ready_;
+    const Clock::time_point epoch_;
+    const Clock::duration resolution_;
+    const size_t capacity_;
+    std::unique_ptr<Timer[]> timers_;
+    alignas(64) std::atomic<uint64_t> free_;
+    alignas(64) std::atomic<uint32_t> inbox_;
+    alignas(64) std::atomic<uint32_t> cancelled_;
+    alignas(64) std::atomic_flag advancing_;
+    uint64_t processed_;
+    uint32_t wheel_[LEVELS][SLOTS];
+
+    static constexpr uint32_t Ref(uint64_t link)
+    {
+        return static_cast<uint32_t>(link);
+    }
+
+    static constexpr uint64_t Link(uint64_t old, uint32_t ref)
+    {
+        return (((old >> 32) + 1) << 32) | ref;
+    }
+
+    static constexpr uint64_t State(uint64_t generation, uint64_t state)
+    {
+        return (generation << 2) | state;
+    }
+
+    Timer& timer(uint32_t ref)
+    {
+        return timers_[ref - 1];
+    }
+
+    uint64_t toTick(Clock::time_point time) const
+    {
+        if (time <= epoch_)
+        {
+            return 0;
+        }
+        return (time - epoch_ + resolution_ - Clock::duration(1))
+            / resolution_;
+    }
+
+    uint32_t allocate()
+    {
+        uint64_t old(free_.load(std::memory_order_acquire));
+        while (Ref(old))
+        {
+            if (free_.compare_exchange_weak(old,
+                Link(old, timer(Ref(old)).next_.load(
+                    std::memory_order_relaxed)),
+                std::memory_order_acquire,
+                std::memory_order_acquire))
+            {
+                return Ref(old);
+            }
+        }
+        return 0;
+    }
+
+    void release(uint32_t ref)
+    {
+        Timer& released(timer(ref));
+        released.data_ = T();
+        released.state_.store(State(
+            (released.state_.load(std::memory_order_relaxed) >> 2) + 1, 0),
+            std::memory_order_relaxed);
+        uint64_t old(free_.load(std::memory_order_relaxed));
+        do
+        {
+            released.next_.store(Ref(old), std::memory_order_relaxed);
+        } while (!free_.compare_exchange_weak(old, Link(old, ref),
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    // Timers which lost to cancel() are left to the cancelled inbox,
+    // which releases every one of them exactly once.
+    void fire(uint32_t ref)
+    {
+        Timer& fired(timer(ref));
+        uint64_t state(fired.state_.load(std::memory_order_relaxed));
+        if ((state & 3) == PENDING
+            && fired.state_.compare_exchange_strong(state,
+                State(state >> 2, FIRED),
+                std::memory_order_acquire,
+                std::memory_order_relaxed))
+        {
+            ready_.push(std::move(fired.data_));
+            release(ref);
+        }
+    }
+
+    uint32_t& slot(uint32_t index)
+    {
+        return wheel_[index / SLOTS][index % SLOTS];
+    }
+
+    void link(uint32_t ref, uint32_t index)
+    {
+        Timer& linked(timer(ref));
+        uint32_t& head(slot(index));
+        linked.next_.store(head, std::memory_order_relaxed);
+        linked.prev_ = 0;
+        linked.slot_ = index + 1;
+        if (head)
+        {
+            timer(head).prev_ = ref;
+        }
+        head = ref;
+    }
+
+    void unlink(uint32_t ref)
+    {
+        Timer& unlinked(timer(ref));
+        if (!unlinked.slot_)
+        {
+            return;
+        }
+        const uint32_t next(unlinked.next_.load(std::memory_order_relaxed));
+        if (unlinked.prev_)
+        {
+            timer(unlinked.prev_).next_.store(next,
+                std::memory_order_relaxed);
+        }
+        else
+        {
+            slot(unlinked.slot_ - 1) = next;
+        }
+        if (next)
+        {
+            timer(next).prev_ = unlinked.prev_;
+        }
+        unlinked.slot_ = 0;
+    }
+
+    void place(uint32_t ref)
+    {
+        Timer& placed(timer(ref));
+        placed.slot_ = 0;
+        if ((placed.state_.load(std::memory_order_relaxed) & 3) != PENDING)
+        {
+            return;
+        }
+        if (placed.deadline_ <= processed_)
+        {
+            fire(ref);
+            return;
+        }
+        const uint64_t delta(placed.deadline_ - processed_);
+        size_t level(0);
+        while (level + 1 < LEVELS && delta >> (SLOT_BITS * (level + 1)))
+        {
+            ++level;
+        }
+        link(ref, static_cast<uint32_t>(level * SLOTS
+            + ((placed.deadline_ >> (SLOT_BITS * level)) & (SLOTS - 1))));
+    }
+
+    void drain(uint32_t& head)
+    {
+        uint32_t ref(head);
+        head = 0;
+        while (ref)
+        {
+            const uint32_t next(timer(ref).next_.load(
+                std::memory_order_relaxed));
+            place(ref);
+            ref = next;
+        }
+    }
+
+public:
+    explicit DelayQueue(const DelayQueue&) = delete;
+    const DelayQueue& operator=(const DelayQueue&) = delete;
+
+    explicit DelayQueue(size_t capacity,
+        Clock::duration resolution = std::chrono::milliseconds(1))
+        : ready_(),
+        epoch_(Clock::now()),
+        resolution_(resolution),
+        capacity_(capacity < UINT32_MAX ? capacity : UINT32_MAX - 1),
+        timers_(new Timer[capacity_]),
+        free_(0),
+        inbox_(0),
+        cancelled_(0),
+        processed_(0),
+        wheel_()
+    {
+        advancing_.clear();
+        for (uint32_t ref = 1; ref <= capacity_; ++ref)
+        {
+            timer(ref).deadline_ = 0;
+            timer(ref).next_.store(ref < capacity_ ? ref + 1 : 0,
+                std::memory_order_relaxed);
+            timer(ref).cancelNext_.store(0, std::memory_order_relaxed);
+            timer(ref).prev_ = 0;
+            timer(ref).slot_ = 0;
+            timer(ref).state_.store(State(1, 0), std::memory_order_relaxed);
+        }
+        free_.store(capacity_ ? 1 : 0, std::memory_order_release);
+    }
+
+    // Returns 0 when all capacity timers are in use.
+    Handle pushAt(const T& value, Clock::time_point deadline)
+    {
+        const uint32_t ref(allocate());
+        if (!ref)
+        {
+            return 0;
+        }
+        Timer& pushed(timer(ref));
+        pushed.data_ = value;
+        pushed.deadline_ = toTick(deadline);
+        const uint64_t generation(
+            pushed.state_.load(std::memory_order_relaxed) >> 2);
+        pushed.state_.store(State(generation, PENDING),
+            std::memory_order_relaxed);
+        uint32_t old(inbox_.load(std::memory_order_relaxed));
+        do
+        {
+            pushed.next_.store(old, std::memory_order_relaxed);
+        } while (!inbox_.compare_exchange_weak(old, ref,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+        return (generation << 32) | ref;
+    }
+
+    Handle pushAfter(const T& value, Clock::duration delay)
+    {
+        return pushAt(value, Clock::now() + delay);
+    }
+
+    // True when the timer was still pending; its element is dropped and
+    // its pool slot comes back on the next advance().
+    bool cancel(Handle handle)
+    {
+        const uint32_t ref(Ref(handle));
+        if (!ref || ref > capacity_)
+        {
+            return false;
+        }
+        Timer& cancelled(timer(ref));
+        uint64_t expected(State(handle >> 32, PENDING));
+        if (!cancelled.state_.compare_exchange_strong(expected,
+            State(handle >> 32, CANCELLED),
+            std::memory_order_relaxed,
+            std::memory_order_relaxed))
+        {
+            return false;
+        }
+        uint32_t old(cancelled_.load(std::memory_order_relaxed));
+        do
+        {
+            cancelled.cancelNext_.store(old, std::memory_order_relaxed);
+        } while (!cancelled_.compare_exchange_weak(old, ref,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+        return true;
+    }
+
+    // Moves due timers into the ready queue. Returns at once when another
+    // thread is already advancing the wheel.
+    void advance()
+    {
+        if (advancing_.test_and_set(std::memory_order_acquire))
+        {
+            return;
+        }
+        // Timers are cancelled after they were pushed, so taking the
+        // cancelled inbox first means each of them is already in the
+        // wheel or in the batch placed below.
+        uint32_t cancelled(cancelled_.exchange(0, std::memory_order_acquire));
+        uint32_t pushed(inbox_.exchange(0, std::memory_order_acquire));
+        drain(pushed);
+        while (cancelled)
+        {
+            const uint32_t next(timer(cancelled).cancelNext_.load(
+                std::memory_order_relaxed));
+            unlink(cancelled);
+            release(cancelled);
+            cancelled = next;
+        }
+        const uint64_t now((Clock::now() - epoch_) / resolution_);
+        while (processed_ < now)
+        {
+            const uint64_t tick(++processed_);
+            for (size_t level = LEVELS - 1; level > 0; --level)
+            {
+                if (!(tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)))
+                {
+                    drain(wheel_[level][
+                        (tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+                }
+            }
+            drain(wheel_[0][tick & (SLOTS - 1)]);
+        }
+        advancing_.clear(std::memory_order_release);
+    }
+
+    bool pop(T& value)
+    {
+        advance();
+        return ready_.pop(value);
+    }
+
+    bool isEmpty() const
+    {
+        return ready_.isEmpty();
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        LockFreeQueue<T, MAX_THREADS, GC_NUM,
+            Allocator>::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        LockFreeQueue<T, MAX_THREADS, GC_NUM,
+            Allocator>::ReclaimHazardNodes();
+    }
+};
+
+#endif
@@ -0,0 +1,189 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// LockFreeQueue with an eventfd that becomes readable when the queue goes
+// from empty to non-empty, for consumers running an epoll loop. Only the
+// producer that finds the queue armed writes the eventfd, so under
+// sustained load pushes make no syscalls. Register fd() level triggered
+// and call popBulk() on readiness; it re-arms once the queue runs dry.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Allocator = std::allocator<T> >
+class alignas(void*) EventQueue
+{
+private:
+    LockFreeQueue<T, MAX_THREADS, GC_NUM, Allocator> queue_;
+    alignas(64) std::atomic<bool> armed_;
+    const int fd_;
+
+    void notify()
+    {
+        if (armed_.load() && armed_.exchange(false))
+        {
+            const uint64_t one(1);
+            while (write(fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+            {
+            }
+        }
+    }
+
+    // Returns false when a push raced with re-arming and this consumer
+    // took the notification back, so it should keep popping.
+    bool rearm()
+    {
+        uint64_t count;
+        while (read(fd_, &count, sizeof(count)) < 0 && errno == EINTR)
+        {
+        }
+        armed_.store(true);
+        if (queue_.isEmpty())
+        {
+            return true;
+        }
+        return !armed_.exchange(false);
+    }
+
+public:
+    explicit EventQueue(const EventQueue&) = delete;
+    const EventQueue& operator=(const EventQueue&) = delete;
+
+    EventQueue()
+        : queue_(),
+        armed_(true),
+        fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+        if (fd_ < 0)
+        {
+            fprintf(stderr, "EventQueue eventfd failed\n");
+        }
+    }
+
+    ~EventQueue()
+    {
+        if (fd_ >= 0)
+        {
+            close(fd_);
+        }
+    }
+
+    int fd() const
+    {
+        return fd_;
+    }
+
+    bool push(const T& value)
+    {
+        if (!queue_.push(value))
+        {
+            return false;
+        }
+        notify();
+        return true;
+    }
+
+    bool push(T&& value)
+    {
+        if (!queue_.push(std::move(value)))
+        {
+            return false;
+        }
+        notify();
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        return queue_.pop(value);
+    }
+
+    // Pops up to count values. When fewer than count are returned the queue
+    // was drained and the eventfd re-armed; otherwise the eventfd stays
+    // readable and the loop will come back for the rest.
+    size_t popBulk(T* values, size_t count)
+    {
+        size_t popped(0);
+        while (popped < count)
+        {
+            if (queue_.pop(values[popped]))
+            {
+                ++popped;
+            }
+            else if (rearm())
+            {
+                break;
+            }
+        }
+        return popped;
+    }
+
+    bool isEmpty() const
+    {
+        return queue_.isEmpty();
+    }
+
+    size_t sizeApprox() const
+    {
+        return queue_.sizeApprox();
+    }
+};
+
+#endif
@@ -0,0 +1,186 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef FENCE_H
+#define FENCE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Fences pairing hazard publication with the reclamation scan. Built with
+// HAZARD_POINTER_ASYMMETRIC_FENCE, publication is a release store plus a
+// compiler barrier and the scan pays for both sides with one
+// membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED); until registration has
+// succeeded both sides fall back to a full fence. Use it with a large
+// GC_NUM, since every scan becomes a syscall.
+class AsymmetricFence
+{
+private:
+    static std::atomic<bool>& Registered()
+    {
+        static std::atomic<bool> registered(false);
+        return registered;
+    }
+
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+    static bool DoRegister()
+    {
+        if (syscall(__NR_membarrier,
+            MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) != 0)
+        {
+            fprintf(stderr, "membarrier register failed\n");
+            return false;
+        }
+        Registered().store(true);
+        return true;
+    }
+#endif
+
+public:
+    static bool Register()
+    {
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+        static const bool registered(DoRegister());
+        return registered;
+#else
+        return false;
+#endif
+    }
+
+    static void Light()
+    {
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+        if (Registered().load(std::memory_order_relaxed))
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    static void Heavy()
+    {
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+        if (Registered().load(std::memory_order_relaxed)
+            && syscall(__NR_membarrier,
+                MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) == 0)
+        {
+            return;
+        }
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+};
+
+template<typename HpNode>
+void PublishHazard(std::atomic<HpNode*>& hazard, HpNode* node)
+{
+#ifdef HAZARD_POINTER_ASYMMETRIC_FENCE
+    hazard.store(node, std::memory_order_release);
+    AsymmetricFence::Light();
+#else
+    hazard.store(node);
+#endif
+}
+
+// Sorted copy of the hazard pointers published when a scan starts, shared
+// by the per node type domains of HazardPointer.h and by HazardDomain, so
+// a batch of retired nodes is checked with binary searches rather than one
+// pass over every slot per node.
+template<typename Pointer>
+class HazardSnapshot
+{
+private:
+    std::vector<Pointer> hazards_;
+
+public:
+    void clear()
+    {
+        hazards_.clear();
+    }
+
+    // Adds the non-null pointer_ of every slot in [slots, slots + count).
+    template<typename Slot>
+    void collect(const Slot* slots, size_t count)
+    {
+        for (size_t i = 0; slots && i < count; ++i)
+        {
+            const Pointer pointer(
+                slots[i].pointer_.load(std::memory_order_acquire));
+            if (pointer)
+            {
+                hazards_.push_back(pointer);
+            }
+        }
+    }
+
+    // Called once every slot has been collected, before covers().
+    void seal()
+    {
+        std::sort(hazards_.begin(), hazards_.end());
+    }
+
+    bool covers(Pointer pointer) const
+    {
+        return std::binary_search(hazards_.begin(), hazards_.end(), pointer);
+    }
+};
+
+#endif
@@ -0,0 +1,399 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HAZARD_DOMAIN_H
+#define HAZARD_DOMAIN_H
+
+#include "Fence.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Type erased hazard pointer domain for lock-free structures built outside
+// this library: readers protect() pointers through a HazardHolder, writers
+// retire() unlinked objects with a deleter. Retired objects are recorded
+// in nodes allocated out of line, spread over cache line padded shards, and
+// freed in batches once a shard holds threshold of them and no hazard
+// pointer covers them. Hazard slots live in blocks that are added as more
+// holders are needed.
+//
+// The queues of this library do not use it. They keep the per node type
+// domain of HazardPointer.h, whose fixed slots per thread and typed retire
+// lists need no holder object, no deleter and no allocation per retire on
+// their pop paths. Both scan their slots through the same HazardSnapshot.
+class HazardDomain
+{
+private:
+    friend class HazardHolder;
+
+    enum : size_t { SLOTS_PER_BLOCK = 64, SHARDS = 8 };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<bool> used_;
+        std::atomic<const void*> pointer_;
+    };
+
+    struct Block
+    {
+        Slot slots_[SLOTS_PER_BLOCK];
+        Block* next_;
+    };
+
+    struct Retired
+    {
+        void* pointer_;
+        void (*reclaim_)(void*, void*);
+        void* deleter_;
+        Retired* next_;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::atomic<Retired*> head_;
+        std::atomic<size_t> count_;
+    };
+
+    // Stateless deleters that can be default constructed are rebuilt at
+    // reclaim time; anything else, captureless lambdas included before
+    // C++20, is kept as a copy next to the retired object.
+    template<typename T, typename Deleter,
+        bool EMPTY = std::is_empty<Deleter>::value
+            && std::is_default_constructible<Deleter>::value>
+    struct Reclaimer
+    {
+        static void* Keep(Deleter&&)
+        {
+            return nullptr;
+        }
+        static void Reclaim(void* pointer, void*)
+        {
+            Deleter()(static_cast<T*>(pointer));
+        }
+    };
+
+    template<typename T, typename Deleter>
+    struct Reclaimer<T, Deleter, false>
+    {
+        static void* Keep(Deleter&& deleter)
+        {
+            return new Deleter(std::move(deleter));
+        }
+        static void Reclaim(void* pointer, void* context)
+        {
+            std::unique_ptr<Deleter> deleter(static_cast<Deleter*>(context));
+            (*deleter)(static_cast<T*>(pointer));
+        }
+    };
+
+    const size_t threshold_;
+    std::atomic<Block*> blocks_;
+    Shard shards_[SHARDS];
+
+    static size_t ShardIndex()
+    {
+        static std::atomic<size_t> next(0);
+        static thread_local const size_t index(
+            next.fetch_add(1, std::memory_order_relaxed) % SHARDS);
+        return index;
+    }
+
+    Slot* acquire()
+    {
+        for (Block* block(blocks_.load(std::memory_order_acquire)); block;
+            block = block->next_)
+        {
+            for (Slot& slot : block->slots_)
+            {
+                bool expected(false);
+                if (!slot.used_.load(std::memory_order_relaxed)
+                    && slot.used_.compare_exchange_strong(expected, true))
+                {
+                    return &slot;
+                }
+            }
+        }
+        void* memory(nullptr);
+        if (posix_memalign(&memory, alignof(Block), sizeof(Block)))
+        {
+            throw std::bad_alloc();
+        }
+        Block* const block(new (memory) Block());
+        block->slots_[0].used_.store(true, std::memory_order_relaxed);
+        Block* head(blocks_.load(std::memory_order_relaxed));
+        do
+        {
+            block->next_ = head;
+        } while (!blocks_.compare_exchange_weak(head, block,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+        return &block->slots_[0];
+    }
+
+    static void Release(Slot* slot)
+    {
+        slot->pointer_.store(nullptr, std::memory_order_release);
+        slot->used_.store(false, std::memory_order_release);
+    }
+
+    void push(Shard& shard, Retired* first, Retired* last, size_t count)
+    {
+        Retired* head(shard.head_.load(std::memory_order_relaxed));
+        do
+        {
+            last->next_ = head;
+        } while (!shard.head_.compare_exchange_weak(head, first,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+        shard.count_.fetch_add(count, std::memory_order_relaxed);
+    }
+
+public:
+    explicit HazardDomain(const HazardDomain&) = delete;
+    const HazardDomain& operator=(const HazardDomain&) = delete;
+
+    explicit HazardDomain(size_t threshold = 1024)
+        : threshold_(threshold),
+        blocks_(nullptr),
+        shards_()
+    {
+        AsymmetricFence::Register();
+    }
+
+    // Every holder must be gone; whatever is still retired is freed.
+    ~HazardDomain()
+    {
+        for (Shard& shard : shards_)
+        {
+            Retired* node(shard.head_.load(std::memory_order_acquire));
+            while (node)
+            {
+                Retired* const next(node->next_);
+                node->reclaim_(node->pointer_, node->deleter_);
+                delete node;
+                node = next;
+            }
+        }
+        Block* block(blocks_.load(std::memory_order_acquire));
+        while (block)
+        {
+            Block* const next(block->next_);
+            block->~Block();
+            free(block);
+            block = next;
+        }
+    }
+
+    static HazardDomain& Default()
+    {
+        static HazardDomain domain;
+        return domain;
+    }
+
+    template<typename T, typename Deleter = std::default_delete<T> >
+    void retire(T* pointer, Deleter deleter = Deleter())
+    {
+        if (!pointer)
+        {
+            return;
+        }
+        using Erased = Reclaimer<T, typename std::decay<Deleter>::type>;
+        Retired* const node(new Retired{ pointer, &Erased::Reclaim,
+            Erased::Keep(std::move(deleter)), nullptr });
+        Shard& shard(shards_[ShardIndex()]);
+        push(shard, node, node, 1);
+        if (shard.count_.load(std::memory_order_relaxed) >= threshold_)
+        {
+            reclaim();
+        }
+    }
+
+    // Frees every retired object no hazard pointer covers.
+    void reclaim()
+    {
+        Retired* lists[SHARDS];
+        for (size_t i = 0; i < SHARDS; ++i)
+        {
+            lists[i] = shards_[i].head_.exchange(nullptr,
+                std::memory_order_acquire);
+        }
+        AsymmetricFence::Heavy();
+        HazardSnapshot<const void*> hazards;
+        for (Block* block(blocks_.load(std::memory_order_acquire)); block;
+            block = block->next_)
+        {
+            hazards.collect(block->slots_, SLOTS_PER_BLOCK);
+        }
+        hazards.seal();
+        for (size_t i = 0; i < SHARDS; ++i)
+        {
+            Retired* kept(nullptr);
+            Retired* keptLast(nullptr);
+            size_t count(0);
+            size_t detached(0);
+            Retired* node(lists[i]);
+            while (node)
+            {
+                ++detached;
+                Retired* const next(node->next_);
+                if (hazards.covers(node->pointer_))
+                {
+                    node->next_ = kept;
+                    kept = node;
+                    keptLast = keptLast ? keptLast : node;
+                    ++count;
+                }
+                else
+                {
+                    node->reclaim_(node->pointer_, node->deleter_);
+                    delete node;
+                }
+                node = next;
+            }
+            if (detached)
+            {
+                shards_[i].count_.fetch_sub(detached,
+                    std::memory_order_relaxed);
+            }
+            if (kept)
+            {
+                push(shards_[i], kept, keptLast, count);
+            }
+        }
+    }
+
+    size_t retired() const
+    {
+        size_t count(0);
+        for (const Shard& shard : shards_)
+        {
+            count += shard.count_.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+};
+
+// One hazard slot of a HazardDomain, held for the holder's lifetime.
+class HazardHolder
+{
+private:
+    HazardDomain* domain_;
+    HazardDomain::Slot* slot_;
+
+public:
+    explicit HazardHolder(const HazardHolder&) = delete;
+    const HazardHolder& operator=(const HazardHolder&) = delete;
+
+    explicit HazardHolder(HazardDomain& domain = HazardDomain::Default())
+        : domain_(&domain),
+        slot_(domain.acquire())
+    {
+    }
+
+    HazardHolder(HazardHolder&& other)
+        : domain_(other.domain_),
+        slot_(other.slot_)
+    {
+        other.slot_ = nullptr;
+    }
+
+    ~HazardHolder()
+    {
+        if (slot_)
+        {
+            HazardDomain::Release(slot_);
+        }
+    }
+
+    // Returns source's current value, guaranteed not to be reclaimed
+    // until reset() or another protect().
+    template<typename T>
+    T* protect(const std::atomic<T*>& source)
+    {
+        T* pointer(source.load(std::memory_order_relaxed));
+        for (;;)
+        {
+            PublishHazard(slot_->pointer_,
+                static_cast<const void*>(pointer));
+            T* const current(source.load(std::memory_order_acquire));
+            if (current == pointer)
+            {
+                return pointer;
+            }
+            pointer = current;
+        }
+    }
+
+    // Publishes pointer without validating it; the caller must check that
+    // it is still reachable afterwards.
+    template<typename T>
+    void reset(T* pointer)
+    {
+        PublishHazard(slot_->pointer_, static_cast<const void*>(pointer));
+    }
+
+    void reset()
+    {
+        slot_->pointer_.store(nullptr, std::memory_order_release);
+    }
+
+    HazardDomain& domain() const
+    {
+        return *domain_;
+    }
+};
+
+#endif
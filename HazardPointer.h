@@ -53,10 +53,19 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define HAZARD_POINTER_H
 
 #include "Node.h"
-#include "Chain.h"
+#include "Counter.h"
+#include "Numa.h"
+#include "Fence.h"
+#include "Backoff.h"
 #include <thread>
+#include <algorithm>
 #include <atomic>
+#include <cstdio>
 #include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
 
 template<typename T>
 struct alignas(void*) HazardPointer
@@ -65,21 +74,36 @@ struct alignas(void*) HazardPointer
     std::atomic<T*> pointer_;
 };
 
-template<typename Node>
-class alignas(void*) ContainerOfNodes
+template<typename HpNode, typename Allocator = std::allocator<HpNode>,
+    typename... Args>
+HpNode* NewNode(Args&&... args)
 {
-public:
-    using GetNextPointer = std::atomic<Node*>& (*)(Node*);
-    using Chained = Chain<Node, GetNextPointer>;
-};
+    using Traits = std::allocator_traits<Allocator>;
+    Allocator allocator;
+    HpNode* node(Traits::allocate(allocator, 1));
+    try
+    {
+        Traits::construct(allocator, node, std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+        Traits::deallocate(allocator, node, 1);
+        throw;
+    }
+    return node;
+}
 
-template<typename HpNode>
-void Reclaim(const HpNode* node)
+template<typename HpNode, typename Allocator = std::allocator<HpNode> >
+void Reclaim(HpNode* node)
 {
-    delete node;
+    using Traits = std::allocator_traits<Allocator>;
+    Allocator allocator;
+    Traits::destroy(allocator, node);
+    Traits::deallocate(allocator, node, 1);
 }
 
-template<typename HpNode>
+template<typename HpNode, typename Allocator = std::allocator<HpNode>,
+    typename Backoff = NoBackoff>
 class alignas(void*) MsQueue
 {
 public:
@@ -90,7 +114,7 @@ public:
     const MsQueue& operator=(const MsQueue&) = delete;
 
     MsQueue()
-        : head_(new HpNode()),
+        : head_(NewNode<HpNode, Allocator>()),
         tail_(head_.load(std::memory_order_relaxed))
     {
 
@@ -101,10 +125,15 @@ public:
         const Handler& getNextPointer)
     {
         HpNode* oldTail;
+        Backoff backoff;
         for (;;)
         {
-            hazardPointer.store(tail_.load(std::memory_order_relaxed));
-            oldTail = hazardPointer.load(std::memory_order_acquire);
+            oldTail = tail_.load(std::memory_order_relaxed);
+            PublishHazard(hazardPointer, oldTail);
+            if (tail_.load(std::memory_order_acquire) != oldTail)
+            {
+                continue;
+            }
             HpNode* next(getNextPointer(oldTail).load(
                 std::memory_order_acquire));
             if (next)
@@ -122,7 +151,9 @@ public:
             {
                 break;
             }
+            backoff.onFailure();
         }
+        backoff.onSuccess();
         tail_.compare_exchange_strong(oldTail, newNode,
             std::memory_order_release,
             std::memory_order_relaxed);
@@ -133,20 +164,22 @@ public:
         const Handler& getNextPointer)
     {
         HpNode* oldHead;
+        Backoff backoff;
         for (;;)
         {
-            hp1.store(head_.load(std::memory_order_relaxed));
-            oldHead = hp1.load(std::memory_order_acquire);
+            oldHead = head_.load(std::memory_order_relaxed);
+            PublishHazard(hp1, oldHead);
             if (head_.load(std::memory_order_acquire) != oldHead)
             {
                 continue;
             }
-            hp2.store(getNextPointer(oldHead).load(
-                std::memory_order_relaxed));
-            HpNode* next(hp2.load(std::memory_order_acquire));
+            HpNode* next(getNextPointer(oldHead).load(
+                std::memory_order_acquire));
+            PublishHazard(hp2, next);
             if (!next)
             {
                 hp1.store(nullptr);
+                backoff.onSuccess();
                 return nullptr;
             }
 
@@ -165,7 +198,9 @@ public:
             {
                 break;
             }
+            backoff.onFailure();
         }
+        backoff.onSuccess();
         return oldHead;
     }
 
@@ -225,100 +260,198 @@ public:
     enum { CURRENT, NEXT, PER_THREAD_HP_NUM };
 };
 
-template<typename HpNode, size_t PER_THREAD_HP_NUM, size_t LEN>
+template<typename HpNode, size_t PER_THREAD_HP_NUM, size_t LEN,
+    typename Allocator = std::allocator<HpNode> >
 class QueueHazardPointerOwner;
 
-template<typename HpNode, size_t LEN>
+// Hazard pointer domain of the queues, one per node type. HazardDomain.h
+// offers a type erased domain for other structures; the queues stay on
+// this one for its fixed per-thread slots and typed retire lists.
+//
+// Retired nodes are kept in per-thread arrays rather than linked through
+// the nodes, so nodes need no retire link. Arrays left by exiting threads
+// are pushed here as orphan batches until a later scan frees them.
+template<typename HpNode, size_t LEN,
+    typename Allocator = std::allocator<HpNode> >
 class alignas(void*) HazardPointersSingleton
     : private QueueHazardPointerIndex
 {
 private:
-    using Hp = QueueHazardPointerOwner<HpNode, PER_THREAD_HP_NUM, LEN>;
-    HazardPointer<HpNode> hazardPointers_[LEN];
-    MsQueue<HpNode> queue_;
+    using Hp = QueueHazardPointerOwner<
+        HpNode, PER_THREAD_HP_NUM, LEN, Allocator>;
+
+    struct Orphans
+    {
+        std::vector<HpNode*> nodes_;
+        Orphans* next_;
+    };
+
+    HazardPointer<HpNode>* blocks_[NUMA_MAX_NODES];
+    size_t blockCount_;
+    size_t blockLength_;
+    std::atomic<Orphans*> orphans_;
 
     HazardPointersSingleton()
-        : hazardPointers_(),
-        queue_()
+        : blocks_(),
+        blockCount_(NumaTopology::Instance().nodeCount()),
+        blockLength_((LEN + blockCount_ - 1) / blockCount_),
+        orphans_(nullptr)
     {
+        AsymmetricFence::Register();
+        for (size_t node = 0; node < blockCount_; ++node)
+        {
+            void* block(NumaAlloc(
+                blockLength_ * sizeof(HazardPointer<HpNode>), node));
+            if (!block)
+            {
+                continue;
+            }
+            blocks_[node] = static_cast<HazardPointer<HpNode>*>(block);
+            for (size_t i = 0; i < blockLength_; ++i)
+            {
+                new (&blocks_[node][i]) HazardPointer<HpNode>();
+            }
+        }
     }
 
 public:
     ~HazardPointersSingleton()
     {
-        auto head(queue_.head_.load(std::memory_order_relaxed));
-        while (head)
+        Orphans* orphans(orphans_.load(std::memory_order_relaxed));
+        while (orphans)
+        {
+            for (HpNode* node : orphans->nodes_)
+            {
+                Reclaim<HpNode, Allocator>(node);
+            }
+            Orphans* const next(orphans->next_);
+            delete orphans;
+            orphans = next;
+        }
+        for (size_t node = 0; node < blockCount_; ++node)
         {
-            const auto tmp(head);
-            head = head->hpNext_.load(std::memory_order_relaxed);
-            delete tmp;
+            NumaFree(blocks_[node],
+                blockLength_ * sizeof(HazardPointer<HpNode>));
         }
     }
 
-    static HazardPointersSingleton<HpNode, LEN>& Instance()
+    static HazardPointersSingleton<HpNode, LEN, Allocator>& Instance()
     {
-        static HazardPointersSingleton<HpNode, LEN> hps;
+        static HazardPointersSingleton<HpNode, LEN, Allocator> hps;
         return hps;
     }
 
-    HazardPointer<HpNode>* get()
+    HazardPointer<HpNode>* block(size_t node)
+    {
+        return blocks_[node % blockCount_];
+    }
+
+    constexpr size_t blockCount() const
+    {
+        return blockCount_;
+    }
+
+    constexpr size_t blockLength() const
     {
-        return hazardPointers_;
+        return blockLength_;
     }
 
     bool isExist(const HpNode* ptr)
     {
-        for (const auto& iter : hazardPointers_)
+        for (size_t node = 0; node < blockCount_; ++node)
         {
-            if (iter.pointer_.load(std::memory_order_acquire) == ptr)
+            const HazardPointer<HpNode>* block(blocks_[node]);
+            for (size_t i = 0; block && i < blockLength_; ++i)
             {
-                return true;
+                if (block[i].pointer_.load(std::memory_order_acquire) == ptr)
+                {
+                    return true;
+                }
             }
         }
         return false;
     }
 
-    bool reclaimLater(HpNode* first, HpNode* last)
+    // Collects every published hazard pointer, sorted, so a batch of nodes
+    // can be checked with binary searches instead of one scan per node.
+    void snapshot(HazardSnapshot<const HpNode*>& hazards)
     {
-        std::atomic<HpNode*>& hazardTail = Hp::GetHazardPointer(CURRENT);
-        return queue_.append(hazardTail, first, last, GetHpNextNode<HpNode>);
+        hazards.clear();
+        for (size_t node = 0; node < blockCount_; ++node)
+        {
+            hazards.collect(blocks_[node], blockLength_);
+        }
+        hazards.seal();
     }
-    bool reclaimLater(HpNode* node)
+
+    // Waits until every hazard pointer published before the call has been
+    // changed or cleared, so nodes unlinked before it may be reused.
+    void synchronize()
     {
-        std::atomic<HpNode*>& hazardTail = Hp::GetHazardPointer(CURRENT);
-        return queue_.append(hazardTail, node, GetHpNextNode<HpNode>);
+        AsymmetricFence::Heavy();
+        for (size_t node = 0; node < blockCount_; ++node)
+        {
+            const HazardPointer<HpNode>* block(blocks_[node]);
+            for (size_t i = 0; block && i < blockLength_; ++i)
+            {
+                const HpNode* const ptr(
+                    block[i].pointer_.load(std::memory_order_acquire));
+                while (ptr
+                    && block[i].pointer_.load(std::memory_order_acquire)
+                    == ptr)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
     }
+
+    void reclaimLater(std::vector<HpNode*>& nodes)
+    {
+        if (nodes.empty())
+        {
+            return;
+        }
+        Orphans* const orphans(new Orphans{ std::move(nodes), nullptr });
+        nodes.clear();
+        Orphans* old(orphans_.load(std::memory_order_relaxed));
+        do
+        {
+            orphans->next_ = old;
+        } while (!orphans_.compare_exchange_weak(old, orphans,
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
     void reclaimHazardNodes()
     {
-        std::atomic<HpNode*>& hazardHead(Hp::GetHazardPointer(CURRENT));
-        std::atomic<HpNode*>& hazardNext(Hp::GetHazardPointer(NEXT));
-        typename ContainerOfNodes<HpNode>::Chained chain(GetHpNextNode<HpNode>);
-        for (;;)
+        Orphans* orphans(orphans_.exchange(nullptr,
+            std::memory_order_acquire));
+        if (!orphans)
         {
-            HpNode* oldHead(queue_.pop(hazardHead, hazardNext,
-                GetHpNextNode<HpNode>));
-            if (!oldHead)
-            {
-                break;
-            }
-            hazardHead.store(nullptr);
-            hazardNext.store(nullptr);
-            if (!isExist(oldHead))
-            {
-                Reclaim(oldHead);
-            }
-            else
-            {
-                chain.pushFront(oldHead);
-            }
+            return;
         }
-        if (chain.head())
+        AsymmetricFence::Heavy();
+        std::vector<HpNode*> kept;
+        while (orphans)
         {
-            if (!reclaimLater(chain.moveHead(), chain.moveTail()))
+            for (HpNode* node : orphans->nodes_)
             {
-                fprintf(stderr, "Hps::reclaimLater(HpNode*, HpNode*) failed\n");
+                if (!isExist(node))
+                {
+                    Reclaim<HpNode, Allocator>(node);
+                    Hp::RetiredCounter().add(-1);
+                }
+                else
+                {
+                    kept.push_back(node);
+                }
             }
+            Orphans* const next(orphans->next_);
+            delete orphans;
+            orphans = next;
         }
+        reclaimLater(kept);
     }
 };
 
@@ -328,8 +461,12 @@ void InitialHazardPointer(HazardPointer<HpNode>* global,
     HazardPointer<HpNode>** local,
     const size_t localLen)
 {
-    for (size_t i = 0; i < localLen; ++i)
+    for (size_t i = 0; global && i < localLen; ++i)
     {
+        if (local[i])
+        {
+            continue;
+        }
         for (size_t j = 0; j < globalLen; ++j)
         {
             std::thread::id old;
@@ -345,23 +482,29 @@ void InitialHazardPointer(HazardPointer<HpNode>* global,
     }
 }
 
-template<typename HpNode, size_t PER_THREAD_HP_NUM, size_t LEN>
+template<typename HpNode, size_t PER_THREAD_HP_NUM, size_t LEN,
+    typename Allocator>
 class alignas(void*) QueueHazardPointerOwner
 {
 private:
-    using Hps = HazardPointersSingleton<HpNode, LEN>;
+    using Hps = HazardPointersSingleton<HpNode, LEN, Allocator>;
 
     HazardPointer<HpNode>* hp_[PER_THREAD_HP_NUM];
-    typename ContainerOfNodes<HpNode>::Chained chain_;
-    size_t count_;
+    std::vector<HpNode*> retired_;
+    size_t reported_;
 
     QueueHazardPointerOwner()
         : hp_{ nullptr },
-        chain_(GetHpNextNode<HpNode>),
-        count_(0)
+        retired_(),
+        reported_(0)
     {
-        HazardPointer<HpNode>* hps(Hps::Instance().get());
-        InitialHazardPointer(hps, LEN, hp_, PER_THREAD_HP_NUM);
+        Hps& hps(Hps::Instance());
+        const size_t node(NumaTopology::CurrentNode());
+        for (size_t i = 0; i < hps.blockCount(); ++i)
+        {
+            InitialHazardPointer(hps.block(node + i), hps.blockLength(),
+                hp_, PER_THREAD_HP_NUM);
+        }
         if (!hp_[PER_THREAD_HP_NUM - 1])
         {
             fprintf(stderr, "get hazard pointer failed\n");
@@ -369,10 +512,10 @@ private:
     }
 
     static QueueHazardPointerOwner<
-        HpNode, PER_THREAD_HP_NUM, LEN>& Instance()
+        HpNode, PER_THREAD_HP_NUM, LEN, Allocator>& Instance()
     {
         static thread_local QueueHazardPointerOwner<
-            HpNode, PER_THREAD_HP_NUM, LEN> hp;
+            HpNode, PER_THREAD_HP_NUM, LEN, Allocator> hp;
         return hp;
     }
 
@@ -381,6 +524,26 @@ private:
         return hp_[index]->pointer_;
     }
 
+    static StripedCounter<>& RetiredCounter()
+    {
+        static StripedCounter<> counter;
+        return counter;
+    }
+
+    // The domain-wide count only learns about local retires once per scan,
+    // so ReclaimLater() stays free of shared writes.
+    void report()
+    {
+        if (retired_.size() != reported_)
+        {
+            RetiredCounter().add(static_cast<int64_t>(retired_.size())
+                - static_cast<int64_t>(reported_));
+            reported_ = retired_.size();
+        }
+    }
+
+    friend class HazardPointersSingleton<HpNode, LEN, Allocator>;
+
 public:
     explicit QueueHazardPointerOwner(
         const QueueHazardPointerOwner&) = delete;
@@ -390,23 +553,8 @@ public:
     ~QueueHazardPointerOwner()
     {
         ReclaimLocalHazardNodes();
-        if (count_)
-        {
-            bool ret(true);
-            if (count_ == 1)
-            {
-                ret = Hps::Instance().reclaimLater(chain_.head());
-            }
-            else
-            {
-                ret = Hps::Instance().reclaimLater(
-                    chain_.head(), chain_.tail());
-            }
-            if (!ret)
-            {
-                fprintf(stderr, "Hps::reclaimLater(HpNode*, HpNode*) failed\n");
-            }
-        }
+        Hps::Instance().reclaimLater(retired_);
+        reported_ = 0;
         for (const auto& iter : hp_)
         {
             iter->pointer_.store(nullptr);
@@ -421,29 +569,33 @@ public:
 
     static void ReclaimLater(HpNode* hazard)
     {
-        Instance().chain_.pushFront(hazard);
-        ++Instance().count_;
+        Instance().retired_.push_back(hazard);
     }
 
     static void ReclaimLocalHazardNodes()
     {
-        HpNode* current(Instance().chain_.moveHead());
-        Instance().chain_.moveTail();
-        while (current)
+        QueueHazardPointerOwner& owner(Instance());
+        std::vector<HpNode*>& retired(owner.retired_);
+        if (retired.empty())
         {
-            HpNode* const next(current->hpNext_.load(
-                std::memory_order_relaxed));
-            if (!Hps::Instance().isExist(current))
+            return;
+        }
+        AsymmetricFence::Heavy();
+        Hps& hps(Hps::Instance());
+        size_t kept(0);
+        for (HpNode* node : retired)
+        {
+            if (!hps.isExist(node))
             {
-                Reclaim(current);
+                Reclaim<HpNode, Allocator>(node);
             }
             else
             {
-                ReclaimLater(current);
+                retired[kept++] = node;
             }
-            --Instance().count_;
-            current = next;
         }
+        retired.resize(kept);
+        owner.report();
     }
 
     static void ReclaimHazardNodes()
@@ -452,9 +604,20 @@ public:
         Hps::Instance().reclaimHazardNodes();
     }
 
-    constexpr static size_t Length()
+    static void Synchronize()
+    {
+        Hps::Instance().synchronize();
+    }
+
+    static size_t Length()
+    {
+        return Instance().retired_.size();
+    }
+
+    static size_t Retired()
     {
-        return Instance().count_;
+        const int64_t retired(RetiredCounter().sum());
+        return retired > 0 ? retired : 0;
     }
 };
 
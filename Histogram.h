@@ -0,0 +1,216 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Log-linear histogram in the style of HdrHistogram. Values below
+// SUB_BUCKETS are exact; above that every power of two is split into
+// SUB_BUCKETS linear buckets, so a bucket is never wider than 1/16 of
+// the values it holds.
+class LatencyHistogram
+{
+public:
+    enum : size_t
+    {
+        SUB_BUCKET_BITS = 4,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+    };
+
+private:
+    uint64_t counts_[BUCKETS];
+    uint64_t count_;
+
+public:
+    LatencyHistogram()
+        : counts_(),
+        count_(0)
+    {
+    }
+
+    static size_t BucketOf(uint64_t value)
+    {
+        if (value < SUB_BUCKETS)
+        {
+            return value;
+        }
+        const size_t shift(63 - __builtin_clzll(value) - SUB_BUCKET_BITS);
+        return (shift + 1) * SUB_BUCKETS
+            + ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    static uint64_t LowerBound(size_t bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+        {
+            return bucket;
+        }
+        return (SUB_BUCKETS + bucket % SUB_BUCKETS)
+            << (bucket / SUB_BUCKETS - 1);
+    }
+
+    static uint64_t UpperBound(size_t bucket)
+    {
+        return bucket + 1 < BUCKETS ? LowerBound(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+    void add(size_t bucket, uint64_t count)
+    {
+        counts_[bucket] += count;
+        count_ += count;
+    }
+
+    void record(uint64_t value)
+    {
+        add(BucketOf(value), 1);
+    }
+
+    void merge(const LatencyHistogram& other)
+    {
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+        {
+            add(bucket, other.counts_[bucket]);
+        }
+    }
+
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    uint64_t countAt(size_t bucket) const
+    {
+        return counts_[bucket];
+    }
+
+    // Upper edge of the bucket holding the given percentile, 0 when empty.
+    uint64_t valueAtPercentile(double percentile) const
+    {
+        if (!count_)
+        {
+            return 0;
+        }
+        uint64_t rank(static_cast<uint64_t>(percentile / 100.0 * count_));
+        rank = rank < 1 ? 1 : (rank > count_ ? count_ : rank);
+        uint64_t seen(0);
+        for (size_t bucket = 0; bucket < BUCKETS; ++bucket)
+        {
+            seen += counts_[bucket];
+            if (seen >= rank)
+            {
+                return UpperBound(bucket);
+            }
+        }
+        return UINT64_MAX;
+    }
+};
+
+// LatencyHistogram counters split over stripes the way StripedCounter
+// splits its value, so concurrent record() calls rarely share a line.
+template<size_t STRIPES = 8>
+class alignas(64) StripedHistogram
+{
+private:
+    struct alignas(64) Stripe
+    {
+        std::atomic<uint64_t> counts_[LatencyHistogram::BUCKETS];
+    };
+
+    Stripe stripes_[STRIPES];
+
+    static size_t Index()
+    {
+        static std::atomic<size_t> next(0);
+        static thread_local const size_t index(
+            next.fetch_add(1, std::memory_order_relaxed) % STRIPES);
+        return index;
+    }
+
+public:
+    explicit StripedHistogram(const StripedHistogram&) = delete;
+    const StripedHistogram& operator=(const StripedHistogram&) = delete;
+
+    StripedHistogram()
+        : stripes_()
+    {
+    }
+
+    void record(uint64_t value)
+    {
+        stripes_[Index()].counts_[LatencyHistogram::BucketOf(value)]
+            .fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Adds the current counts to histogram; only exact when quiescent.
+    void snapshot(LatencyHistogram& histogram) const
+    {
+        for (const auto& stripe : stripes_)
+        {
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS;
+                ++bucket)
+            {
+                const uint64_t count(stripe.counts_[bucket].load(
+                    std::memory_order_relaxed));
+                if (count)
+                {
+                    histogram.add(bucket, count);
+                }
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,227 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef INTRUSIVE_QUEUE_H
+#define INTRUSIVE_QUEUE_H
+
+#include "Node.h"
+#include "HazardPointer.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Allocator seen by the hazard domain of an IntrusiveQueue. Retired user
+// objects go back to the Disposer; only the sentinels the queues create
+// for themselves are really allocated and freed here.
+template<typename T, typename Disposer>
+struct IntrusiveAllocator
+{
+    using value_type = T;
+
+    template<typename U>
+    struct rebind
+    {
+        using other = IntrusiveAllocator<U, Disposer>;
+    };
+
+    IntrusiveAllocator() = default;
+
+    template<typename U>
+    IntrusiveAllocator(const IntrusiveAllocator<U, Disposer>&)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return std::allocator<T>().allocate(count);
+    }
+
+    template<typename... Args>
+    void construct(T* object, Args&&... args)
+    {
+        new (object) T(std::forward<Args>(args)...);
+        object->stub_ = true;
+    }
+
+    void destroy(T*)
+    {
+    }
+
+    void deallocate(T* object, size_t count)
+    {
+        if (object->stub_)
+        {
+            object->~T();
+            std::allocator<T>().deallocate(object, count);
+        }
+        else
+        {
+            Disposer()(object);
+        }
+    }
+};
+
+template<typename T, typename U, typename Disposer>
+bool operator==(const IntrusiveAllocator<T, Disposer>&,
+    const IntrusiveAllocator<U, Disposer>&)
+{
+    return true;
+}
+
+template<typename T, typename U, typename Disposer>
+bool operator!=(const IntrusiveAllocator<T, Disposer>&,
+    const IntrusiveAllocator<U, Disposer>&)
+{
+    return false;
+}
+
+// Queue of user owned objects deriving from node_type::IntrusiveHook<T>,
+// linked through the hook, so push and pop neither allocate nor copy. The
+// queue sentinel needs T to be default constructible. A popped object
+// stays linked as the new sentinel, so popWith() hands it to the reader
+// under a hazard pointer instead of returning it; every object is given
+// to Disposer once it has been unlinked and no hazard pointer holds it.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Disposer = std::default_delete<T> >
+class alignas(void*) IntrusiveQueue
+    : private QueueHazardPointerIndex
+{
+public:
+    using NodeAllocator = IntrusiveAllocator<T, Disposer>;
+
+private:
+    using Hp = QueueHazardPointerOwner<
+        T, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+    MsQueue<T, NodeAllocator> queue_;
+
+public:
+    explicit IntrusiveQueue(const IntrusiveQueue&) = delete;
+    const IntrusiveQueue& operator=(const IntrusiveQueue&) = delete;
+
+    IntrusiveQueue()
+        : queue_()
+    {
+    }
+
+    // Objects still queued are handed to Disposer.
+    ~IntrusiveQueue()
+    {
+        T* head(queue_.head_.load(std::memory_order_relaxed));
+        while (head)
+        {
+            T* tmp(head);
+            head = head->next_.load(std::memory_order_relaxed);
+            Reclaim<T, NodeAllocator>(tmp);
+        }
+    }
+
+    bool push(T* object)
+    {
+        if (!object)
+        {
+            return false;
+        }
+        object->next_.store(nullptr, std::memory_order_relaxed);
+        std::atomic<T*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        queue_.push(hazardTail, object, GetNextNode<T>);
+        hazardTail.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+    template<typename Reader>
+    bool popWith(const Reader& reader)
+    {
+        std::atomic<T*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        std::atomic<T*>& hazardNext(Hp::GetHazardPointer(NEXT));
+        T* oldHead(queue_.pop(hazardHead, hazardNext, GetNextNode<T>));
+        if (!oldHead)
+        {
+            hazardNext.store(nullptr);
+            return false;
+        }
+        hazardHead.store(nullptr, std::memory_order_relaxed);
+        reader(*hazardNext.load());
+        Hp::ReclaimLater(oldHead);
+        if (Hp::Length() >= GC_NUM)
+        {
+            Hp::ReclaimLocalHazardNodes();
+        }
+        hazardNext.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        std::atomic<T*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        T* head;
+        do
+        {
+            head = queue_.head_.load(std::memory_order_relaxed);
+            PublishHazard(hazardHead, head);
+        } while (queue_.head_.load(std::memory_order_acquire) != head);
+        const bool empty(!head->next_.load(std::memory_order_acquire));
+        hazardHead.store(nullptr, std::memory_order_release);
+        return empty;
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        Hp::ReclaimHazardNodes();
+    }
+};
+
+#endif
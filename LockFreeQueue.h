@@ -53,29 +53,207 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define LOCK_FREE_QUEUE_H
 
 #include "Node.h"
+#include "Chain.h"
 #include "HazardPointer.h"
+#include "Counter.h"
 #include <atomic>
 #include <memory>
+#include <thread>
 
-template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0>
+// Backoff is the contention manager of the CAS loops, see Backoff.h.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Allocator = std::allocator<T>, typename Backoff = NoBackoff>
 class alignas(void*) LockFreeQueue
     : private QueueHazardPointerIndex
 {
 public:
     using Node = node_type::NodeWithHazardPointer<T>;
     using Chained = Chain<Node, void>;
+    using NodeAllocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Node>;
 
 private:
     using Hp = QueueHazardPointerOwner<
-        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2>;
-    MsQueue<Node> queue_;
+        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+    enum : size_t { SIZE_ATTEMPTS = 4 };
+    MsQueue<Node, NodeAllocator, Backoff> queue_;
+    const size_t capacity_;
+    const size_t byteBudget_;
+    StripedCounter<> enqueued_;
+    StripedCounter<> dequeued_;
+    CreditPool<> credits_;
+
+    static size_t Credits(size_t capacity, size_t byteBudget)
+    {
+        const size_t nodes(byteBudget / sizeof(Node));
+        return !byteBudget || (capacity && capacity < nodes)
+            ? capacity : nodes;
+    }
+
+    constexpr bool isBounded() const
+    {
+        return capacity_ || byteBudget_;
+    }
+
+    // Credits are taken in per-thread batches, so only a refill looks at
+    // the depth, to keep retired nodes inside the byte budget as well.
+    bool reserve(size_t count)
+    {
+        if (!credits_.acquire(count, [this]()
+            {
+                return !byteBudget_
+                    || (sizeApprox() + Hp::Retired()) * sizeof(Node)
+                    <= byteBudget_;
+            }))
+        {
+            return false;
+        }
+        enqueued_.add(count);
+        return true;
+    }
+
+    void consume(size_t count)
+    {
+        enqueued_.add(count);
+        if (isBounded())
+        {
+            credits_.take(count);
+        }
+    }
+
+    void release(size_t count)
+    {
+        dequeued_.add(count);
+        if (isBounded())
+        {
+            credits_.release(count);
+        }
+    }
+
+    // Detaches every element with one CAS moving head to the last node.
+    // That node stays behind as the new dummy, so its value moves into a
+    // fresh node linked at the end of the detached run; the run keeps
+    // non-null links so a stale push can never link onto it. Finding the
+    // node before the last one walks the run once, so this is O(n) in the
+    // elements moved, though without any CAS after the first. The fresh
+    // node is allocated before that CAS, so a throwing allocator cannot
+    // lose the run.
+    size_t detach(Chained& chain)
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        std::atomic<Node*>& hazardLast(Hp::GetHazardPointer(NEXT));
+        Node* head;
+        Node* last;
+        Node* tail(nullptr);
+        for (;;)
+        {
+            head = queue_.head_.load(std::memory_order_relaxed);
+            PublishHazard(hazardHead, head);
+            if (queue_.head_.load(std::memory_order_acquire) != head)
+            {
+                continue;
+            }
+            last = queue_.tail_.load(std::memory_order_relaxed);
+            PublishHazard(hazardLast, last);
+            if (queue_.tail_.load(std::memory_order_acquire) != last)
+            {
+                continue;
+            }
+            Node* next(last->next_.load(std::memory_order_acquire));
+            if (next)
+            {
+                queue_.tail_.compare_exchange_strong(last, next,
+                    std::memory_order_release,
+                    std::memory_order_relaxed);
+                continue;
+            }
+            if (head == last)
+            {
+                hazardHead.store(nullptr, std::memory_order_relaxed);
+                hazardLast.store(nullptr, std::memory_order_release);
+                if (tail)
+                {
+                    Reclaim<Node, NodeAllocator>(tail);
+                }
+                return 0;
+            }
+            if (!tail)
+            {
+                tail = NewNode<Node, NodeAllocator>();
+                continue;
+            }
+            // acq_rel: later pops that load head_ must see everything
+            // this thread wrote before handing the old head over.
+            if (queue_.head_.compare_exchange_strong(head, last,
+                std::memory_order_acq_rel,
+                std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        hazardHead.store(nullptr, std::memory_order_relaxed);
+        Node* const first(head->next_.load(std::memory_order_acquire));
+        std::swap(tail->data_, last->data_);
+        hazardLast.store(nullptr, std::memory_order_release);
+        size_t count(1);
+        if (first == last)
+        {
+            chain.splice(tail, tail);
+        }
+        else
+        {
+            Node* node(first);
+            for (Node* next(node->next_.load(std::memory_order_relaxed));
+                next != last;
+                next = node->next_.load(std::memory_order_relaxed))
+            {
+                node = next;
+                ++count;
+            }
+            ++count;
+            node->next_.store(tail, std::memory_order_relaxed);
+            chain.splice(first, tail);
+        }
+        release(count);
+        Hp::ReclaimLater(head);
+        if (Hp::Length() >= GC_NUM)
+        {
+            Hp::ReclaimLocalHazardNodes();
+        }
+        return count;
+    }
+
+    void enqueue(Node* newNode)
+    {
+        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        queue_.push(hazardTail, newNode, GetNextNode<Node>);
+        hazardTail.store(nullptr, std::memory_order_release);
+    }
 
 public:
     explicit LockFreeQueue(const LockFreeQueue&) = delete;
     const LockFreeQueue& operator=(const LockFreeQueue&) = delete;
 
     LockFreeQueue()
-        : queue_()
+        : queue_(),
+        capacity_(0),
+        byteBudget_(0),
+        enqueued_(),
+        dequeued_(),
+        credits_(0)
+    {
+    }
+
+    // Bounded queue: tryPush() and pushWait() refuse to go above capacity
+    // elements, or above byteBudget bytes of nodes counting the retired
+    // nodes of the hazard domain. Zero disables either limit.
+    explicit LockFreeQueue(size_t capacity, size_t byteBudget = 0)
+        : queue_(),
+        capacity_(capacity),
+        byteBudget_(byteBudget),
+        enqueued_(),
+        dequeued_(),
+        credits_(Credits(capacity, byteBudget))
     {
     }
 
@@ -86,30 +264,72 @@ public:
         {
             Node* tmp(head);
             head = head->next_.load(std::memory_order_relaxed);
-            delete tmp;
+            Reclaim<Node, NodeAllocator>(tmp);
         }
     }
 
     bool push(const T& value)
     {
-        Node* newNode(new Node(value));
-        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
-        queue_.push(hazardTail, newNode, GetNextNode<Node>);
-        hazardTail.store(nullptr, std::memory_order_release);
+        consume(1);
+        enqueue(NewNode<Node, NodeAllocator>(value));
         return true;
     }
 
     bool push(T&& value)
     {
-        Node* newNode(new Node(std::move(value)));
-        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
-        queue_.push(hazardTail, newNode, GetNextNode<Node>);
-        hazardTail.store(nullptr, std::memory_order_release);
+        consume(1);
+        enqueue(NewNode<Node, NodeAllocator>(std::move(value)));
+        return true;
+    }
+
+    bool tryPush(const T& value)
+    {
+        if (isBounded() && !reserve(1))
+        {
+            return false;
+        }
+        enqueue(NewNode<Node, NodeAllocator>(value));
+        return true;
+    }
+
+    bool tryPush(T&& value)
+    {
+        if (isBounded() && !reserve(1))
+        {
+            return false;
+        }
+        enqueue(NewNode<Node, NodeAllocator>(std::move(value)));
+        return true;
+    }
+
+    bool pushWait(const T& value)
+    {
+        while (isBounded() && !reserve(1))
+        {
+            Hp::ReclaimLocalHazardNodes();
+            std::this_thread::yield();
+        }
+        enqueue(NewNode<Node, NodeAllocator>(value));
+        return true;
+    }
+
+    bool pushWait(T&& value)
+    {
+        while (isBounded() && !reserve(1))
+        {
+            Hp::ReclaimLocalHazardNodes();
+            std::this_thread::yield();
+        }
+        enqueue(NewNode<Node, NodeAllocator>(std::move(value)));
         return true;
     }
 
     bool append(Node* node)
     {
+        if (node)
+        {
+            consume(1);
+        }
         std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
         bool ret(queue_.append(hazardTail, node, GetNextNode<Node>));
         hazardTail.store(nullptr, std::memory_order_release);
@@ -117,6 +337,21 @@ public:
     }
     bool append(Node* first, Node* last)
     {
+        if (first)
+        {
+            int64_t count(0);
+            Node* node(first);
+            while (node)
+            {
+                ++count;
+                if (node == last)
+                {
+                    break;
+                }
+                node = node->next_.load(std::memory_order_relaxed);
+            }
+            consume(count);
+        }
         std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
         bool ret(queue_.append(hazardTail, first, last, GetNextNode<Node>));
         hazardTail.store(nullptr, std::memory_order_release);
@@ -142,6 +377,7 @@ public:
             return false;
         }
         hazardHead.store(nullptr, std::memory_order_relaxed);
+        release(1);
         std::swap(value, hazardNext.load()->data_);
         Hp::ReclaimLater(oldHead);
         if (Hp::Length() >= GC_NUM)
@@ -152,6 +388,37 @@ public:
         return true;
     }
 
+    // Moves every element into chain with one CAS and returns how many.
+    // Waits for hazard pointers published before the detach to move on,
+    // so the nodes may be freed or relinked right away.
+    size_t drain(Chained& chain)
+    {
+        const size_t count(detach(chain));
+        if (count)
+        {
+            Hp::Synchronize();
+        }
+        return count;
+    }
+
+    // Moves every element of other onto the tail of this queue with one
+    // append, keeping their order; returns how many were moved.
+    size_t spliceFrom(LockFreeQueue& other)
+    {
+        Chained chain;
+        const size_t count(other.detach(chain));
+        if (!count)
+        {
+            return 0;
+        }
+        consume(count);
+        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        queue_.append(hazardTail, chain.moveHead(), chain.moveTail(),
+            GetNextNode<Node>);
+        hazardTail.store(nullptr, std::memory_order_release);
+        return count;
+    }
+
     static void ReclaimLocalHazardNodes()
     {
         Hp::ReclaimLocalHazardNodes();
@@ -159,7 +426,82 @@ public:
 
     bool isEmpty() const
     {
-        return queue_.head_.load() == queue_.tail_.load();
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        Node* head;
+        do
+        {
+            head = queue_.head_.load(std::memory_order_relaxed);
+            PublishHazard(hazardHead, head);
+        } while (queue_.head_.load(std::memory_order_acquire) != head);
+        const bool empty(!head->next_.load(std::memory_order_acquire));
+        hazardHead.store(nullptr, std::memory_order_release);
+        return empty;
+    }
+
+    // Depth from the striped counters; may be briefly off while pushes and
+    // pops are in flight, but never touches a shared hot line.
+    size_t sizeApprox() const
+    {
+        const int64_t dequeued(dequeued_.sum());
+        const int64_t size(enqueued_.sum() - dequeued);
+        return size > 0 ? size : 0;
+    }
+
+    // Counts the nodes from head to the tail seen at the start, for
+    // diagnostics: O(n) and a cache miss per element. head stays hazard
+    // protected, so while it has not moved no node behind it can have been
+    // retired, and the walk only needs to protect the node it steps onto.
+    // A pop moving head restarts the walk; after SIZE_ATTEMPTS restarts
+    // it returns sizeApprox() instead.
+    size_t size() const
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        std::atomic<Node*>& hazardNode(Hp::GetHazardPointer(NEXT));
+        size_t count(0);
+        bool counted(false);
+        for (size_t attempt = 0; !counted && attempt < SIZE_ATTEMPTS;
+            ++attempt)
+        {
+            Node* head;
+            do
+            {
+                head = queue_.head_.load(std::memory_order_relaxed);
+                PublishHazard(hazardHead, head);
+            } while (queue_.head_.load(std::memory_order_acquire) != head);
+            Node* const last(queue_.tail_.load(std::memory_order_acquire));
+            Node* node(head);
+            count = 0;
+            counted = true;
+            while (node != last)
+            {
+                Node* const next(node->next_.load(std::memory_order_acquire));
+                if (!next)
+                {
+                    break;
+                }
+                PublishHazard(hazardNode, next);
+                if (queue_.head_.load(std::memory_order_acquire) != head)
+                {
+                    counted = false;
+                    break;
+                }
+                node = next;
+                ++count;
+            }
+        }
+        hazardHead.store(nullptr, std::memory_order_relaxed);
+        hazardNode.store(nullptr, std::memory_order_release);
+        return counted ? count : sizeApprox();
+    }
+
+    size_t enqueued() const
+    {
+        return enqueued_.sum();
+    }
+
+    size_t dequeued() const
+    {
+        return dequeued_.sum();
     }
 
     static void ReclaimHazardNodes()
@@ -63,24 +63,76 @@ struct NodeWithHazardPointer
 {
     T data_;
     std::atomic<NodeWithHazardPointer*> next_;
-    std::atomic<NodeWithHazardPointer*> hpNext_;
 
-    NodeWithHazardPointer() : next_(nullptr), hpNext_(nullptr) {}
+    NodeWithHazardPointer() : next_(nullptr) {}
     explicit NodeWithHazardPointer(const T& data)
        : data_(data),
-         next_(nullptr),
-         hpNext_(nullptr)
+         next_(nullptr)
     {
     }
     explicit NodeWithHazardPointer(T&& data)
        : data_(std::move(data)),
-         next_(nullptr),
-         hpNext_(nullptr)
+         next_(nullptr)
     {
     }
     ~NodeWithHazardPointer() {}
 };
 
+// Base for user types queued intrusively: struct Message
+// : node_type::IntrusiveHook<Message> { ... }.
+template<typename T>
+struct IntrusiveHook
+{
+    std::atomic<T*> next_;
+    bool stub_;
+
+    IntrusiveHook() : next_(nullptr), stub_(false) {}
+    IntrusiveHook(const IntrusiveHook&)
+       : next_(nullptr),
+         stub_(false)
+    {
+    }
+    IntrusiveHook& operator=(const IntrusiveHook&)
+    {
+        return *this;
+    }
+};
+
+template<typename T>
+struct WaitFreeNodeWithHazardPointer
+{
+    T data_;
+    std::atomic<WaitFreeNodeWithHazardPointer*> next_;
+    int enqTid_;
+    std::atomic<int> deqTid_;
+    std::atomic<int> release_;
+
+    WaitFreeNodeWithHazardPointer()
+       : next_(nullptr),
+         enqTid_(-1),
+         deqTid_(-1),
+         release_(1)
+    {
+    }
+    explicit WaitFreeNodeWithHazardPointer(const T& data)
+       : data_(data),
+         next_(nullptr),
+         enqTid_(-1),
+         deqTid_(-1),
+         release_(2)
+    {
+    }
+    explicit WaitFreeNodeWithHazardPointer(T&& data)
+       : data_(std::move(data)),
+         next_(nullptr),
+         enqTid_(-1),
+         deqTid_(-1),
+         release_(2)
+    {
+    }
+    ~WaitFreeNodeWithHazardPointer() {}
+};
+
 }
 
 template <typename Node>
@@ -89,10 +141,4 @@ std::atomic<Node*>& GetNextNode(Node* node)
     return node->next_;
 }
 
-template<typename Node>
-std::atomic<Node*>& GetHpNextNode(Node* node)
-{
-    return node->hpNext_;
-}
-
 #endif
@@ -0,0 +1,267 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstdio>
+#include <cstddef>
+#include <vector>
+#ifdef __linux__
+#include <fstream>
+#include <string>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <new>
+#endif
+
+enum { NUMA_MAX_NODES = 64 };
+
+// Node topology read from /sys on Linux. Elsewhere there is a single node
+// 0 holding every cpu, and NumaAlloc() is plain operator new.
+
+class alignas(void*) NumaTopology
+{
+private:
+    std::vector<size_t> cpuToNode_;
+    std::vector<std::vector<int> > nodeToCpus_;
+
+#ifdef __linux__
+    static std::vector<int> ParseList(const std::string& list)
+    {
+        std::vector<int> values;
+        size_t pos(0);
+        while (pos < list.size())
+        {
+            size_t end(list.find(',', pos));
+            if (end == std::string::npos)
+            {
+                end = list.size();
+            }
+            const std::string range(list.substr(pos, end - pos));
+            const size_t dash(range.find('-'));
+            const int first(atoi(range.c_str()));
+            const int last(dash == std::string::npos
+                ? first : atoi(range.c_str() + dash + 1));
+            for (int i = first; i <= last; ++i)
+            {
+                values.push_back(i);
+            }
+            pos = end + 1;
+        }
+        return values;
+    }
+
+    static std::string ReadLine(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+#endif
+
+    NumaTopology()
+        : cpuToNode_(),
+        nodeToCpus_()
+    {
+#ifdef __linux__
+        const std::vector<int> nodes(ParseList(
+            ReadLine("/sys/devices/system/node/online")));
+        for (const auto node : nodes)
+        {
+            if (node < 0 || node >= NUMA_MAX_NODES)
+            {
+                continue;
+            }
+            if (nodeToCpus_.size() <= static_cast<size_t>(node))
+            {
+                nodeToCpus_.resize(node + 1);
+            }
+            const std::vector<int> cpus(ParseList(ReadLine(
+                "/sys/devices/system/node/node" + std::to_string(node)
+                + "/cpulist")));
+            for (const auto cpu : cpus)
+            {
+                if (cpuToNode_.size() <= static_cast<size_t>(cpu))
+                {
+                    cpuToNode_.resize(cpu + 1, 0);
+                }
+                cpuToNode_[cpu] = node;
+                nodeToCpus_[node].push_back(cpu);
+            }
+        }
+#endif
+        if (nodeToCpus_.empty())
+        {
+            nodeToCpus_.resize(1);
+        }
+    }
+
+public:
+    explicit NumaTopology(const NumaTopology&) = delete;
+    const NumaTopology& operator=(const NumaTopology&) = delete;
+
+    static NumaTopology& Instance()
+    {
+        static NumaTopology topology;
+        return topology;
+    }
+
+    size_t nodeCount() const
+    {
+        return nodeToCpus_.size();
+    }
+
+    size_t nodeOfCpu(int cpu) const
+    {
+        if (cpu < 0 || static_cast<size_t>(cpu) >= cpuToNode_.size())
+        {
+            return 0;
+        }
+        return cpuToNode_[cpu];
+    }
+
+    const std::vector<int>& cpusOfNode(size_t node) const
+    {
+        return nodeToCpus_[node % nodeToCpus_.size()];
+    }
+
+    static size_t CurrentNode()
+    {
+#ifdef __linux__
+        return Instance().nodeOfCpu(sched_getcpu());
+#else
+        return 0;
+#endif
+    }
+};
+
+inline size_t NumaPageSize()
+{
+#ifdef __linux__
+    static const size_t pageSize(sysconf(_SC_PAGESIZE));
+    return pageSize;
+#else
+    return 4096;
+#endif
+}
+
+inline size_t NumaRoundUp(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+inline bool NumaBind(void* addr, size_t len, size_t node)
+{
+    if (NumaTopology::Instance().nodeCount() < 2)
+    {
+        return true;
+    }
+#if defined(__linux__) && defined(SYS_mbind)
+    enum { MPOL_PREFERRED_ = 1 };
+    const size_t bits(sizeof(unsigned long) * 8);
+    unsigned long mask[NUMA_MAX_NODES / (sizeof(unsigned long) * 8)] = {};
+    mask[node / bits] |= 1UL << (node % bits);
+    return syscall(SYS_mbind, addr, len, MPOL_PREFERRED_, mask,
+        NUMA_MAX_NODES + 1, 0) == 0;
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+    return false;
+#endif
+}
+
+inline void* NumaAlloc(size_t size, size_t node)
+{
+    size = NumaRoundUp(size, NumaPageSize());
+#ifdef __linux__
+    void* addr(mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "NumaAlloc() mmap failed\n");
+        return nullptr;
+    }
+    if (!NumaBind(addr, size, node))
+    {
+        fprintf(stderr, "NumaAlloc() mbind failed\n");
+    }
+    return addr;
+#else
+    (void)node;
+    void* const addr(::operator new(size, std::nothrow));
+    if (!addr)
+    {
+        fprintf(stderr, "NumaAlloc() failed\n");
+    }
+    return addr;
+#endif
+}
+
+inline void NumaFree(void* addr, size_t size)
+{
+#ifdef __linux__
+    if (addr)
+    {
+        munmap(addr, NumaRoundUp(size, NumaPageSize()));
+    }
+#else
+    (void)size;
+    ::operator delete(addr);
+#endif
+}
+
+#endif
@@ -0,0 +1,259 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NUMA_LOCK_FREE_QUEUE_H
+#define NUMA_LOCK_FREE_QUEUE_H
+
+#include "Numa.h"
+#include "Arena.h"
+#include "HazardPointer.h"
+#include <atomic>
+#include <memory>
+#include <new>
+
+struct NumaPopStats
+{
+    size_t local_;
+    size_t remote_;
+};
+
+// One MsQueue lane per NUMA node. push() appends to the lane of the calling
+// thread's node; pop() starts from the local lane when PREFER_LOCAL is set
+// and otherwise rotates over the lanes. Order is FIFO per lane only.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    bool PREFER_LOCAL = true>
+class alignas(void*) NumaLockFreeQueue
+    : private QueueHazardPointerIndex
+{
+public:
+    using Node = node_type::NodeWithHazardPointer<T>;
+    using NodeAllocator = ArenaAllocator<Node>;
+
+private:
+    using Hp = QueueHazardPointerOwner<
+        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+    using Lane = MsQueue<Node, NodeAllocator>;
+
+    Lane* lanes_[NUMA_MAX_NODES];
+    const size_t laneCount_;
+
+    static size_t StartLane()
+    {
+        if (PREFER_LOCAL)
+        {
+            return NumaTopology::CurrentNode();
+        }
+        static thread_local size_t next(NumaTopology::CurrentNode());
+        return next++;
+    }
+
+    bool popFrom(Lane& lane, T& value)
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        std::atomic<Node*>& hazardNext(Hp::GetHazardPointer(NEXT));
+        Node* oldHead(lane.pop(hazardHead, hazardNext, GetNextNode<Node>));
+        if (!oldHead)
+        {
+            hazardNext.store(nullptr);
+            return false;
+        }
+        hazardHead.store(nullptr, std::memory_order_relaxed);
+        Node* const next(hazardNext.load());
+        std::swap(value, next->data_);
+        if (NodeAllocator::HomeNode(next) == NumaTopology::CurrentNode())
+        {
+            ++PopStats().local_;
+        }
+        else
+        {
+            ++PopStats().remote_;
+        }
+        Hp::ReclaimLater(oldHead);
+        if (Hp::Length() >= GC_NUM)
+        {
+            Hp::ReclaimLocalHazardNodes();
+        }
+        hazardNext.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+public:
+    explicit NumaLockFreeQueue(const NumaLockFreeQueue&) = delete;
+    const NumaLockFreeQueue& operator=(const NumaLockFreeQueue&) = delete;
+
+    NumaLockFreeQueue()
+        : lanes_(),
+        laneCount_(NumaTopology::Instance().nodeCount())
+    {
+        for (size_t node = 0; node < laneCount_; ++node)
+        {
+            void* lane(NumaAlloc(sizeof(Lane), node));
+            lanes_[node] = lane ? new (lane) Lane() : nullptr;
+            if (!lanes_[node])
+            {
+                fprintf(stderr, "NumaLockFreeQueue lane %zu failed\n", node);
+            }
+        }
+    }
+
+    ~NumaLockFreeQueue()
+    {
+        for (size_t node = 0; node < laneCount_; ++node)
+        {
+            Lane* const lane(lanes_[node]);
+            if (!lane)
+            {
+                continue;
+            }
+            Node* head(lane->head_.load(std::memory_order_relaxed));
+            while (head)
+            {
+                Node* tmp(head);
+                head = head->next_.load(std::memory_order_relaxed);
+                Reclaim<Node, NodeAllocator>(tmp);
+            }
+            lane->~Lane();
+            NumaFree(lane, sizeof(Lane));
+        }
+    }
+
+    bool push(const T& value)
+    {
+        Node* newNode(NewNode<Node, NodeAllocator>(value));
+        if (!append(newNode))
+        {
+            Reclaim<Node, NodeAllocator>(newNode);
+            return false;
+        }
+        return true;
+    }
+
+    bool push(T&& value)
+    {
+        Node* newNode(NewNode<Node, NodeAllocator>(std::move(value)));
+        if (!append(newNode))
+        {
+            Reclaim<Node, NodeAllocator>(newNode);
+            return false;
+        }
+        return true;
+    }
+
+    bool append(Node* node)
+    {
+        Lane* const lane(lanes_[NumaTopology::CurrentNode() % laneCount_]);
+        if (!lane)
+        {
+            return false;
+        }
+        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        bool ret(lane->append(hazardTail, node, GetNextNode<Node>));
+        hazardTail.store(nullptr, std::memory_order_release);
+        return ret;
+    }
+
+    bool pop(T& value)
+    {
+        const size_t start(StartLane());
+        for (size_t i = 0; i < laneCount_; ++i)
+        {
+            Lane* const lane(lanes_[(start + i) % laneCount_]);
+            if (lane && popFrom(*lane, value))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Looks at head->next_ of every lane, as head and tail differ while
+    // a lane's tail lags behind a finished push.
+    bool isEmpty() const
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        bool empty(true);
+        for (size_t node = 0; empty && node < laneCount_; ++node)
+        {
+            const Lane* const lane(lanes_[node]);
+            if (!lane)
+            {
+                continue;
+            }
+            Node* head;
+            do
+            {
+                head = lane->head_.load(std::memory_order_relaxed);
+                PublishHazard(hazardHead, head);
+            } while (lane->head_.load(std::memory_order_acquire) != head);
+            empty = !head->next_.load(std::memory_order_acquire);
+        }
+        hazardHead.store(nullptr, std::memory_order_release);
+        return empty;
+    }
+
+    static NumaPopStats& PopStats()
+    {
+        static thread_local NumaPopStats stats{ 0, 0 };
+        return stats;
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        Hp::ReclaimHazardNodes();
+    }
+};
+
+#endif
@@ -0,0 +1,310 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef PRIORITY_LANE_QUEUE_H
+#define PRIORITY_LANE_QUEUE_H
+
+#include "Node.h"
+#include "HazardPointer.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// PRIORITIES MsQueue lanes, level 0 being the most urgent, sharing one
+// hazard domain. Bit 63 - level of nonEmpty_ is set while a lane may hold
+// elements, so the best lane is one load and a count leading zeros away.
+// With WEIGHTED set, each consumer thread spends weights[level] pops on a
+// level before lower levels get their turn, otherwise levels are strict.
+// A thread keeps separate credits for up to CREDIT_SLOTS queues of a type.
+template<typename T, size_t PRIORITIES, size_t MAX_THREADS,
+    size_t GC_NUM = 0, bool WEIGHTED = false,
+    typename Allocator = std::allocator<T> >
+class alignas(void*) PriorityLaneQueue
+    : private QueueHazardPointerIndex
+{
+    static_assert(PRIORITIES > 0 && PRIORITIES <= 64,
+        "PriorityLaneQueue supports 1 to 64 levels");
+
+public:
+    using Node = node_type::NodeWithHazardPointer<T>;
+    using NodeAllocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Node>;
+
+private:
+    using Hp = QueueHazardPointerOwner<
+        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+    using Lane = MsQueue<Node, NodeAllocator>;
+
+    struct alignas(64) PaddedLane
+    {
+        Lane lane_;
+    };
+
+    enum : size_t { CREDIT_SLOTS = 8 };
+
+    struct Credits
+    {
+        uint64_t owner_;
+        uint64_t eligible_;
+        size_t left_[PRIORITIES];
+    };
+
+    PaddedLane lanes_[PRIORITIES];
+    alignas(64) std::atomic<uint64_t> nonEmpty_;
+    size_t weights_[PRIORITIES];
+    const uint64_t id_;
+
+    static constexpr uint64_t Bit(size_t level)
+    {
+        return uint64_t(1) << (63 - level);
+    }
+
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Credits of the calling thread for this queue. Ids are handed out in
+    // sequence, so queues created together land in different slots; a
+    // slot taken over by another queue starts from fresh credits.
+    Credits& localCredits() const
+    {
+        static thread_local Credits credits[CREDIT_SLOTS] = {};
+        Credits& slot(credits[id_ % CREDIT_SLOTS]);
+        if (slot.owner_ != id_)
+        {
+            slot.owner_ = id_;
+            slot.eligible_ = 0;
+        }
+        return slot;
+    }
+
+    static bool LaneEmpty(const Lane& lane)
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        Node* head;
+        do
+        {
+            head = lane.head_.load(std::memory_order_relaxed);
+            PublishHazard(hazardHead, head);
+        } while (lane.head_.load(std::memory_order_acquire) != head);
+        const bool empty(!head->next_.load(std::memory_order_acquire));
+        hazardHead.store(nullptr, std::memory_order_release);
+        return empty;
+    }
+
+    void enqueue(size_t level, Node* newNode)
+    {
+        std::atomic<Node*>& hazardTail(Hp::GetHazardPointer(CURRENT));
+        lanes_[level].lane_.push(hazardTail, newNode, GetNextNode<Node>);
+        hazardTail.store(nullptr, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!(nonEmpty_.load() & Bit(level)))
+        {
+            nonEmpty_.fetch_or(Bit(level));
+        }
+    }
+
+    bool popFrom(size_t level, T& value)
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        std::atomic<Node*>& hazardNext(Hp::GetHazardPointer(NEXT));
+        Node* oldHead(lanes_[level].lane_.pop(
+            hazardHead, hazardNext, GetNextNode<Node>));
+        if (!oldHead)
+        {
+            hazardNext.store(nullptr);
+            nonEmpty_.fetch_and(~Bit(level));
+            if (!LaneEmpty(lanes_[level].lane_))
+            {
+                nonEmpty_.fetch_or(Bit(level));
+            }
+            return false;
+        }
+        hazardHead.store(nullptr, std::memory_order_relaxed);
+        std::swap(value, hazardNext.load()->data_);
+        Hp::ReclaimLater(oldHead);
+        if (Hp::Length() >= GC_NUM)
+        {
+            Hp::ReclaimLocalHazardNodes();
+        }
+        hazardNext.store(nullptr, std::memory_order_release);
+        return true;
+    }
+
+public:
+    explicit PriorityLaneQueue(const PriorityLaneQueue&) = delete;
+    const PriorityLaneQueue& operator=(const PriorityLaneQueue&) = delete;
+
+    PriorityLaneQueue()
+        : lanes_(),
+        nonEmpty_(0),
+        id_(NextId())
+    {
+        for (size_t level = 0; level < PRIORITIES; ++level)
+        {
+            weights_[level] = PRIORITIES - level;
+        }
+    }
+
+    explicit PriorityLaneQueue(const size_t (&weights)[PRIORITIES])
+        : lanes_(),
+        nonEmpty_(0),
+        id_(NextId())
+    {
+        for (size_t level = 0; level < PRIORITIES; ++level)
+        {
+            weights_[level] = weights[level] ? weights[level] : 1;
+        }
+    }
+
+    ~PriorityLaneQueue()
+    {
+        for (auto& padded : lanes_)
+        {
+            Node* head(padded.lane_.head_.load(std::memory_order_relaxed));
+            while (head)
+            {
+                Node* tmp(head);
+                head = head->next_.load(std::memory_order_relaxed);
+                Reclaim<Node, NodeAllocator>(tmp);
+            }
+        }
+    }
+
+    bool push(size_t level, const T& value)
+    {
+        if (level >= PRIORITIES)
+        {
+            return false;
+        }
+        enqueue(level, NewNode<Node, NodeAllocator>(value));
+        return true;
+    }
+
+    bool push(size_t level, T&& value)
+    {
+        if (level >= PRIORITIES)
+        {
+            return false;
+        }
+        enqueue(level, NewNode<Node, NodeAllocator>(std::move(value)));
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        for (;;)
+        {
+            const uint64_t nonEmpty(nonEmpty_.load(std::memory_order_acquire));
+            if (!nonEmpty)
+            {
+                return false;
+            }
+            uint64_t candidates(nonEmpty);
+            if (WEIGHTED)
+            {
+                Credits& credits(localCredits());
+                if (!(candidates & credits.eligible_))
+                {
+                    credits.eligible_ = 0;
+                    for (size_t level = 0; level < PRIORITIES; ++level)
+                    {
+                        credits.left_[level] = weights_[level];
+                        credits.eligible_ |= Bit(level);
+                    }
+                }
+                candidates &= credits.eligible_;
+            }
+            const size_t level(__builtin_clzll(candidates));
+            if (popFrom(level, value))
+            {
+                if (WEIGHTED)
+                {
+                    Credits& credits(localCredits());
+                    if (!--credits.left_[level])
+                    {
+                        credits.eligible_ &= ~Bit(level);
+                    }
+                }
+                return true;
+            }
+        }
+    }
+
+    bool isEmpty() const
+    {
+        uint64_t nonEmpty(nonEmpty_.load());
+        while (nonEmpty)
+        {
+            const size_t level(__builtin_clzll(nonEmpty));
+            if (!LaneEmpty(lanes_[level].lane_))
+            {
+                return false;
+            }
+            nonEmpty &= ~Bit(level);
+        }
+        return true;
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        Hp::ReclaimHazardNodes();
+    }
+};
+
+#endif
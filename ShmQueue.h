@@ -0,0 +1,613 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SHM_QUEUE_H
+#define SHM_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Michael-Scott queue living entirely inside a shm_open() region, so that
+// several processes can exchange fixed size records. Links are 64 bit words
+// holding a 32 bit ABA tag and a 32 bit node reference (index + 1, 0 is
+// null), which keeps the region position independent. Every thread works
+// through an Owner, which claims one hazard slot in the region. Retired
+// nodes handed over by exiting owners are chained through retireNext_, so
+// the queue link of a node that may still be hazard protected is never
+// written.
+template<typename T, size_t SLOTS = 64>
+class alignas(void*) ShmQueue
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+        "ShmQueue records must be trivially copyable");
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2,
+        "ShmQueue needs address free 64 bit atomics");
+
+private:
+    enum : uint64_t { MAGIC = 0x4c46514d53485132ULL };
+    enum { CURRENT, NEXT, PER_THREAD_HP_NUM };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint64_t> owner_;
+        std::atomic<uint32_t> hazard_[PER_THREAD_HP_NUM];
+    };
+
+    struct alignas(64) Header
+    {
+        std::atomic<uint64_t> magic_;
+        uint64_t capacity_;
+        uint64_t recordSize_;
+        alignas(64) std::atomic<uint64_t> head_;
+        alignas(64) std::atomic<uint64_t> tail_;
+        alignas(64) std::atomic<uint64_t> free_;
+        alignas(64) std::atomic<uint64_t> orphans_;
+        Slot slots_[SLOTS];
+    };
+
+    struct alignas(64) ShmNode
+    {
+        std::atomic<uint64_t> next_;
+        std::atomic<uint32_t> retireNext_;
+        T data_;
+    };
+
+    Header* header_;
+    size_t size_;
+
+    static constexpr uint32_t Ref(uint64_t link)
+    {
+        return static_cast<uint32_t>(link);
+    }
+
+    static constexpr uint64_t Link(uint64_t old, uint32_t ref)
+    {
+        return (((old >> 32) + 1) << 32) | ref;
+    }
+
+    static size_t RegionSize(size_t capacity)
+    {
+        return sizeof(Header) + (capacity + 1) * sizeof(ShmNode);
+    }
+
+    ShmNode& node(uint32_t ref) const
+    {
+        return reinterpret_cast<ShmNode*>(header_ + 1)[ref - 1];
+    }
+
+    void pushFree(std::atomic<uint64_t>& list, uint32_t first,
+        uint32_t last)
+    {
+        uint64_t old(list.load(std::memory_order_relaxed));
+        do
+        {
+            node(last).next_.store(
+                Link(node(last).next_.load(std::memory_order_relaxed),
+                    Ref(old)),
+                std::memory_order_relaxed);
+        } while (!list.compare_exchange_weak(old, Link(old, first),
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    void pushOrphans(uint32_t first, uint32_t last)
+    {
+        std::atomic<uint64_t>& orphans(header_->orphans_);
+        uint64_t old(orphans.load(std::memory_order_relaxed));
+        do
+        {
+            node(last).retireNext_.store(Ref(old),
+                std::memory_order_relaxed);
+        } while (!orphans.compare_exchange_weak(old, Link(old, first),
+            std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+
+    uint32_t popFree()
+    {
+        uint64_t old(header_->free_.load(std::memory_order_acquire));
+        while (Ref(old))
+        {
+            const uint64_t next(node(Ref(old)).next_.load(
+                std::memory_order_relaxed));
+            if (header_->free_.compare_exchange_weak(old,
+                Link(old, Ref(next)),
+                std::memory_order_acquire,
+                std::memory_order_acquire))
+            {
+                return Ref(old);
+            }
+        }
+        return 0;
+    }
+
+    void initialize(size_t capacity)
+    {
+        header_->capacity_ = capacity;
+        header_->recordSize_ = sizeof(T);
+        for (size_t i = 0; i < SLOTS; ++i)
+        {
+            new (&header_->slots_[i]) Slot();
+        }
+        for (uint32_t ref = 1; ref <= capacity + 1; ++ref)
+        {
+            new (&node(ref)) ShmNode();
+            node(ref).next_.store(ref <= capacity ? ref + 1 : 0,
+                std::memory_order_relaxed);
+            node(ref).retireNext_.store(0, std::memory_order_relaxed);
+        }
+        node(1).next_.store(0, std::memory_order_relaxed);
+        header_->head_.store(1, std::memory_order_relaxed);
+        header_->tail_.store(1, std::memory_order_relaxed);
+        header_->free_.store(capacity ? 2 : 0, std::memory_order_relaxed);
+        header_->orphans_.store(0, std::memory_order_relaxed);
+        header_->magic_.store(MAGIC, std::memory_order_release);
+    }
+
+    bool map(int fd, size_t size)
+    {
+        void* addr(mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0));
+        if (addr == MAP_FAILED)
+        {
+            fprintf(stderr, "ShmQueue mmap failed\n");
+            return false;
+        }
+        header_ = static_cast<Header*>(addr);
+        size_ = size;
+        return true;
+    }
+
+public:
+    class alignas(void*) Owner
+    {
+    private:
+        ShmQueue& queue_;
+        Slot* slot_;
+        std::vector<uint32_t> retired_;
+        const size_t retireThreshold_;
+
+        // Other processes only see retired nodes once they are back on the
+        // free list, so all the owners together must never hold more than
+        // half the pool. Small queues therefore scan after fewer retires.
+        static size_t RetireThreshold(size_t capacity)
+        {
+            const size_t threshold(capacity / (SLOTS * 2));
+            return threshold < 1 ? 1
+                : std::min<size_t>(threshold, SLOTS * PER_THREAD_HP_NUM * 2);
+        }
+
+        void retire(uint32_t ref)
+        {
+            retired_.push_back(ref);
+            if (retired_.size() >= retireThreshold_)
+            {
+                scan();
+            }
+        }
+
+    public:
+        explicit Owner(const Owner&) = delete;
+        const Owner& operator=(const Owner&) = delete;
+
+        explicit Owner(ShmQueue& queue)
+            : queue_(queue),
+            slot_(nullptr),
+            retired_(),
+            retireThreshold_(RetireThreshold(queue.header_->capacity_))
+        {
+            const uint64_t id((static_cast<uint64_t>(getpid()) << 32)
+                | static_cast<uint32_t>(syscall(SYS_gettid)));
+            for (auto& slot : queue_.header_->slots_)
+            {
+                uint64_t old(0);
+                if (slot.owner_.compare_exchange_strong(old, id))
+                {
+                    slot_ = &slot;
+                    break;
+                }
+            }
+            if (!slot_)
+            {
+                fprintf(stderr, "ShmQueue get hazard slot failed\n");
+            }
+        }
+
+        ~Owner()
+        {
+            scan();
+            if (!retired_.empty())
+            {
+                for (size_t i = 1; i < retired_.size(); ++i)
+                {
+                    queue_.node(retired_[i - 1]).retireNext_.store(
+                        retired_[i], std::memory_order_relaxed);
+                }
+                queue_.pushOrphans(retired_.front(), retired_.back());
+            }
+            if (slot_)
+            {
+                for (auto& hazard : slot_->hazard_)
+                {
+                    hazard.store(0);
+                }
+                slot_->owner_.store(0);
+            }
+        }
+
+        constexpr bool isValid() const
+        {
+            return slot_ != nullptr;
+        }
+
+        void scan()
+        {
+            Header* const header(queue_.header_);
+            const uint64_t orphans(header->orphans_.exchange(
+                0, std::memory_order_acquire));
+            for (uint32_t ref = Ref(orphans); ref;
+                ref = queue_.node(ref).retireNext_.load(
+                    std::memory_order_relaxed))
+            {
+                retired_.push_back(ref);
+            }
+            std::vector<uint32_t> hazards;
+            for (const auto& slot : header->slots_)
+            {
+                for (const auto& hazard : slot.hazard_)
+                {
+                    const uint32_t ref(hazard.load());
+                    if (ref)
+                    {
+                        hazards.push_back(ref);
+                    }
+                }
+            }
+            std::sort(hazards.begin(), hazards.end());
+            size_t kept(0);
+            for (const auto ref : retired_)
+            {
+                if (std::binary_search(hazards.begin(), hazards.end(), ref))
+                {
+                    retired_[kept++] = ref;
+                }
+                else
+                {
+                    queue_.pushFree(header->free_, ref, ref);
+                }
+            }
+            retired_.resize(kept);
+        }
+
+        template<typename Writer>
+        bool pushWith(const Writer& writer)
+        {
+            if (!slot_)
+            {
+                return false;
+            }
+            uint32_t ref(queue_.popFree());
+            if (!ref)
+            {
+                scan();
+                ref = queue_.popFree();
+                if (!ref)
+                {
+                    return false;
+                }
+            }
+            ShmNode& newNode(queue_.node(ref));
+            writer(newNode.data_);
+            newNode.next_.store(
+                Link(newNode.next_.load(std::memory_order_relaxed), 0),
+                std::memory_order_relaxed);
+
+            Header* const header(queue_.header_);
+            std::atomic<uint32_t>& hazardTail(slot_->hazard_[CURRENT]);
+            uint64_t oldTail;
+            for (;;)
+            {
+                oldTail = header->tail_.load(std::memory_order_relaxed);
+                hazardTail.store(Ref(oldTail));
+                if (header->tail_.load(std::memory_order_acquire) != oldTail)
+                {
+                    continue;
+                }
+                std::atomic<uint64_t>& link(queue_.node(Ref(oldTail)).next_);
+                uint64_t next(link.load(std::memory_order_acquire));
+                if (Ref(next))
+                {
+                    header->tail_.compare_exchange_weak(oldTail,
+                        Link(oldTail, Ref(next)),
+                        std::memory_order_release,
+                        std::memory_order_relaxed);
+                    continue;
+                }
+                if (link.compare_exchange_strong(next, Link(next, ref),
+                    std::memory_order_release,
+                    std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            header->tail_.compare_exchange_strong(oldTail,
+                Link(oldTail, ref),
+                std::memory_order_release,
+                std::memory_order_relaxed);
+            hazardTail.store(0, std::memory_order_release);
+            return true;
+        }
+
+        template<typename Reader>
+        bool popWith(const Reader& reader)
+        {
+            if (!slot_)
+            {
+                return false;
+            }
+            Header* const header(queue_.header_);
+            std::atomic<uint32_t>& hazardHead(slot_->hazard_[CURRENT]);
+            std::atomic<uint32_t>& hazardNext(slot_->hazard_[NEXT]);
+            uint64_t oldHead;
+            uint32_t next;
+            for (;;)
+            {
+                oldHead = header->head_.load(std::memory_order_relaxed);
+                hazardHead.store(Ref(oldHead));
+                if (header->head_.load(std::memory_order_acquire) != oldHead)
+                {
+                    continue;
+                }
+                const uint64_t oldTail(header->tail_.load(
+                    std::memory_order_acquire));
+                next = Ref(queue_.node(Ref(oldHead)).next_.load(
+                    std::memory_order_acquire));
+                hazardNext.store(next);
+                if (header->head_.load(std::memory_order_acquire) != oldHead)
+                {
+                    continue;
+                }
+                if (!next)
+                {
+                    hazardHead.store(0, std::memory_order_release);
+                    return false;
+                }
+                if (Ref(oldHead) == Ref(oldTail))
+                {
+                    uint64_t expected(oldTail);
+                    header->tail_.compare_exchange_strong(expected,
+                        Link(oldTail, next),
+                        std::memory_order_release,
+                        std::memory_order_relaxed);
+                    continue;
+                }
+                if (header->head_.compare_exchange_strong(oldHead,
+                    Link(oldHead, next),
+                    std::memory_order_acquire,
+                    std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            hazardHead.store(0, std::memory_order_release);
+            reader(static_cast<const T&>(queue_.node(next).data_));
+            hazardNext.store(0, std::memory_order_release);
+            retire(Ref(oldHead));
+            return true;
+        }
+
+        bool push(const T& value)
+        {
+            return pushWith([&value](T& data) { data = value; });
+        }
+
+        bool pop(T& value)
+        {
+            return popWith([&value](const T& data) { value = data; });
+        }
+    };
+
+    explicit ShmQueue(const ShmQueue&) = delete;
+    const ShmQueue& operator=(const ShmQueue&) = delete;
+
+    // Creates the region when capacity is not zero, otherwise attaches to
+    // an existing one and waits up to attachTimeoutMs for its creator to
+    // finish initializing. isValid() is false when either fails.
+    ShmQueue(const char* name, size_t capacity,
+        size_t attachTimeoutMs = 1000)
+        : header_(nullptr),
+        size_(0)
+    {
+        if (capacity >= UINT32_MAX)
+        {
+            fprintf(stderr, "ShmQueue capacity too large\n");
+            return;
+        }
+        const int fd(capacity
+            ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)
+            : shm_open(name, O_RDWR, 0600));
+        if (fd < 0)
+        {
+            fprintf(stderr, "ShmQueue shm_open(%s) failed\n", name);
+            return;
+        }
+        if (capacity)
+        {
+            if (ftruncate(fd, RegionSize(capacity)) != 0)
+            {
+                fprintf(stderr, "ShmQueue ftruncate(%s) failed\n", name);
+            }
+            else if (map(fd, RegionSize(capacity)))
+            {
+                initialize(capacity);
+            }
+            if (!header_)
+            {
+                shm_unlink(name);
+            }
+            close(fd);
+            return;
+        }
+        const auto deadline(std::chrono::steady_clock::now()
+            + std::chrono::milliseconds(attachTimeoutMs));
+        struct stat st;
+        for (;;)
+        {
+            if (fstat(fd, &st) != 0)
+            {
+                fprintf(stderr, "ShmQueue fstat(%s) failed\n", name);
+                close(fd);
+                return;
+            }
+            if (static_cast<size_t>(st.st_size) >= sizeof(Header))
+            {
+                break;
+            }
+            if (std::chrono::steady_clock::now() >= deadline)
+            {
+                fprintf(stderr, "ShmQueue(%s) attach timed out\n", name);
+                close(fd);
+                return;
+            }
+            std::this_thread::yield();
+        }
+        if (map(fd, st.st_size))
+        {
+            bool ready(true);
+            while (header_->magic_.load(std::memory_order_acquire) != MAGIC)
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    fprintf(stderr, "ShmQueue(%s) attach timed out\n", name);
+                    ready = false;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+            if (ready && (header_->recordSize_ != sizeof(T)
+                || RegionSize(header_->capacity_) > size_))
+            {
+                fprintf(stderr, "ShmQueue(%s) layout mismatch\n", name);
+                ready = false;
+            }
+            if (!ready)
+            {
+                munmap(header_, size_);
+                header_ = nullptr;
+            }
+        }
+        close(fd);
+    }
+
+    ~ShmQueue()
+    {
+        if (header_)
+        {
+            munmap(header_, size_);
+        }
+    }
+
+    constexpr bool isValid() const
+    {
+        return header_ != nullptr;
+    }
+
+    size_t capacity() const
+    {
+        return header_->capacity_;
+    }
+
+    bool isEmpty() const
+    {
+        return !Ref(node(Ref(header_->head_.load())).next_.load());
+    }
+
+    // Frees the hazard slots of processes which died without detaching.
+    // Nodes they had retired are not recovered.
+    void reapDeadOwners()
+    {
+        for (auto& slot : header_->slots_)
+        {
+            const uint64_t owner(slot.owner_.load());
+            if (owner && kill(static_cast<pid_t>(owner >> 32), 0) != 0
+                && errno == ESRCH)
+            {
+                for (auto& hazard : slot.hazard_)
+                {
+                    hazard.store(0);
+                }
+                uint64_t expected(owner);
+                slot.owner_.compare_exchange_strong(expected, 0);
+            }
+        }
+    }
+
+    static bool Unlink(const char* name)
+    {
+        return shm_unlink(name) == 0;
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SOJOURN_QUEUE_H
+#define SOJOURN_QUEUE_H
+
+#include "LockFreeQueue.h"
+#include "Histogram.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cheap timestamps for sojourn times: the TSC on x86, which is invariant
+// and synchronised across cores on current parts, steady_clock nanoseconds
+// elsewhere.
+class SojournClock
+{
+private:
+    static double Calibrate()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        const auto start(std::chrono::steady_clock::now());
+        const uint64_t ticks(Now());
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const double elapsed(std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count());
+        return (Now() - ticks) / elapsed;
+#else
+        return 1.0;
+#endif
+    }
+
+public:
+    static uint64_t Now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Calibrated on first use, which sleeps for 10 ms.
+    static double TicksPerNanosecond()
+    {
+        static const double ticks(Calibrate());
+        return ticks;
+    }
+
+    static double ToNanoseconds(uint64_t ticks)
+    {
+        return ticks / TicksPerNanosecond();
+    }
+};
+
+// LockFreeQueue that stamps every element at push and records how long it
+// sat in the queue at pop, in SojournClock ticks. The stamp travels with
+// the element, so plain LockFreeQueue nodes stay as they are.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Allocator = std::allocator<T> >
+class alignas(void*) SojournQueue
+{
+private:
+    struct Stamped
+    {
+        T value_;
+        uint64_t stamp_;
+
+        Stamped()
+            : value_(),
+            stamp_(0)
+        {
+        }
+        Stamped(const T& value, uint64_t stamp)
+            : value_(value),
+            stamp_(stamp)
+        {
+        }
+        Stamped(T&& value, uint64_t stamp)
+            : value_(std::move(value)),
+            stamp_(stamp)
+        {
+        }
+    };
+
+    using Queue = LockFreeQueue<Stamped, MAX_THREADS, GC_NUM,
+        typename std::allocator_traits<
+            Allocator>::template rebind_alloc<Stamped> >;
+
+    Queue queue_;
+    StripedHistogram<> sojourn_;
+
+public:
+    explicit SojournQueue(const SojournQueue&) = delete;
+    const SojournQueue& operator=(const SojournQueue&) = delete;
+
+    SojournQueue()
+        : queue_(),
+        sojourn_()
+    {
+    }
+
+    bool push(const T& value)
+    {
+        return queue_.push(Stamped(value, SojournClock::Now()));
+    }
+
+    bool push(T&& value)
+    {
+        return queue_.push(Stamped(std::move(value), SojournClock::Now()));
+    }
+
+    bool pop(T& value)
+    {
+        Stamped stamped;
+        if (!queue_.pop(stamped))
+        {
+            return false;
+        }
+        const uint64_t now(SojournClock::Now());
+        sojourn_.record(now > stamped.stamp_ ? now - stamped.stamp_ : 0);
+        value = std::move(stamped.value_);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return queue_.isEmpty();
+    }
+
+    size_t sizeApprox() const
+    {
+        return queue_.sizeApprox();
+    }
+
+    // Adds this queue's sojourn times so far to histogram, so snapshots of
+    // several queues merge by passing the same histogram.
+    void snapshot(LatencyHistogram& histogram) const
+    {
+        sojourn_.snapshot(histogram);
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Queue::ReclaimLocalHazardNodes();
+    }
+};
+
+#endif
@@ -0,0 +1,375 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPILL_QUEUE_H
+#define SPILL_QUEUE_H
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Append only log of fixed size records kept in memory mapped segment
+// files. Segment files are unlinked as soon as they are created, and fully
+// read segments are recycled for later writes.
+template<typename T>
+class alignas(void*) SpillLog
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+        "SpillLog records must be trivially copyable");
+
+private:
+    enum : size_t { RELEASE_CHUNK = 1 << 20, MAX_RECYCLED = 2 };
+
+    struct Segment
+    {
+        char* base_;
+        size_t size_;
+        size_t written_;
+        size_t read_;
+    };
+
+    const std::string directory_;
+    const size_t segmentSize_;
+    std::deque<Segment> segments_;
+    std::vector<Segment> recycled_;
+    size_t sequence_;
+    size_t size_;
+
+    bool openSegment(Segment& segment)
+    {
+        if (!recycled_.empty())
+        {
+            segment = recycled_.back();
+            recycled_.pop_back();
+            segment.written_ = 0;
+            segment.read_ = 0;
+            return true;
+        }
+        const std::string path(directory_ + "/spill-"
+            + std::to_string(getpid()) + "-"
+            + std::to_string(sequence_++) + ".seg");
+        const int fd(open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600));
+        if (fd < 0)
+        {
+            fprintf(stderr, "SpillLog open(%s) failed\n", path.c_str());
+            return false;
+        }
+        unlink(path.c_str());
+        void* addr(MAP_FAILED);
+        if (ftruncate(fd, segmentSize_) == 0)
+        {
+            addr = mmap(nullptr, segmentSize_, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (addr == MAP_FAILED)
+        {
+            fprintf(stderr, "SpillLog mmap(%s) failed\n", path.c_str());
+            return false;
+        }
+        madvise(addr, segmentSize_, MADV_SEQUENTIAL);
+        segment.base_ = static_cast<char*>(addr);
+        segment.size_ = segmentSize_;
+        segment.written_ = 0;
+        segment.read_ = 0;
+        return true;
+    }
+
+    void closeSegment(const Segment& segment)
+    {
+        madvise(segment.base_, segment.size_, MADV_DONTNEED);
+        if (recycled_.size() < MAX_RECYCLED)
+        {
+            recycled_.push_back(segment);
+        }
+        else
+        {
+            munmap(segment.base_, segment.size_);
+        }
+    }
+
+public:
+    explicit SpillLog(const SpillLog&) = delete;
+    const SpillLog& operator=(const SpillLog&) = delete;
+
+    SpillLog(const std::string& directory, size_t segmentSize)
+        : directory_(directory),
+        segmentSize_((segmentSize + RELEASE_CHUNK - 1)
+            / RELEASE_CHUNK * RELEASE_CHUNK),
+        segments_(),
+        recycled_(),
+        sequence_(0),
+        size_(0)
+    {
+    }
+
+    ~SpillLog()
+    {
+        for (const auto& segment : segments_)
+        {
+            munmap(segment.base_, segment.size_);
+        }
+        for (const auto& segment : recycled_)
+        {
+            munmap(segment.base_, segment.size_);
+        }
+    }
+
+    bool append(const T& value)
+    {
+        if (segments_.empty()
+            || segments_.back().written_ + sizeof(T) > segments_.back().size_)
+        {
+            Segment segment;
+            if (!openSegment(segment))
+            {
+                return false;
+            }
+            segments_.push_back(segment);
+        }
+        Segment& segment(segments_.back());
+        memcpy(segment.base_ + segment.written_, &value, sizeof(T));
+        const size_t done(segment.written_ / RELEASE_CHUNK);
+        segment.written_ += sizeof(T);
+        if (segment.written_ / RELEASE_CHUNK != done)
+        {
+            madvise(segment.base_ + done * RELEASE_CHUNK, RELEASE_CHUNK,
+                MADV_DONTNEED);
+        }
+        ++size_;
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        if (!size_)
+        {
+            return false;
+        }
+        Segment& segment(segments_.front());
+        memcpy(&value, segment.base_ + segment.read_, sizeof(T));
+        segment.read_ += sizeof(T);
+        --size_;
+        if (segment.read_ == segment.written_
+            && (segments_.size() > 1
+                || segment.written_ + sizeof(T) > segment.size_))
+        {
+            closeSegment(segment);
+            segments_.pop_front();
+        }
+        return true;
+    }
+
+    constexpr size_t size() const
+    {
+        return size_;
+    }
+};
+
+// LockFreeQueue which stops growing in memory once its depth passes
+// threshold. From then on producers append to a SpillLog until consumers
+// have drained it, so records keep their order across both parts. The
+// depth is only sampled every few pushes of a thread, so the queue may go
+// past threshold by about threshold / 16 per producer. A thread keeps
+// separate push counts for up to SAMPLE_SLOTS queues of a type.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0>
+class alignas(void*) SpillQueue
+{
+private:
+    enum : size_t { MAX_SAMPLE_INTERVAL = 64, SAMPLE_SLOTS = 8 };
+
+    struct Sampler
+    {
+        uint64_t owner_;
+        size_t pushes_;
+    };
+
+    LockFreeQueue<T, MAX_THREADS, GC_NUM> queue_;
+    std::atomic<bool> spilling_;
+    const size_t threshold_;
+    const size_t sampleInterval_;
+    std::mutex mutex_;
+    SpillLog<T> log_;
+    const uint64_t id_;
+
+    static uint64_t NextId()
+    {
+        static std::atomic<uint64_t> next(1);
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Counts the calling thread's pushes to this queue. A slot taken over
+    // from another queue samples right away, so queues sharing a slot are
+    // checked more often rather than never.
+    bool isDeep() const
+    {
+        static thread_local Sampler samplers[SAMPLE_SLOTS] = {};
+        Sampler& sampler(samplers[id_ % SAMPLE_SLOTS]);
+        if (sampler.owner_ != id_)
+        {
+            sampler.owner_ = id_;
+            sampler.pushes_ = 0;
+        }
+        else if (++sampler.pushes_ % sampleInterval_ != 0)
+        {
+            return false;
+        }
+        return queue_.sizeApprox() >= threshold_;
+    }
+
+    // Returns false when value belongs in the in-memory queue. Once the
+    // log holds records, a failed append is reported through appended
+    // rather than letting value overtake them.
+    bool spill(const T& value, bool& appended)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!spilling_.load(std::memory_order_relaxed))
+        {
+            if (queue_.sizeApprox() < threshold_)
+            {
+                return false;
+            }
+            spilling_.store(true, std::memory_order_relaxed);
+        }
+        appended = log_.append(value);
+        if (!appended && !log_.size())
+        {
+            spilling_.store(false, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+public:
+    explicit SpillQueue(const SpillQueue&) = delete;
+    const SpillQueue& operator=(const SpillQueue&) = delete;
+
+    SpillQueue(const std::string& directory, size_t threshold,
+        size_t segmentSize = 64 << 20)
+        : queue_(),
+        spilling_(false),
+        threshold_(threshold),
+        sampleInterval_(threshold / 16 > MAX_SAMPLE_INTERVAL
+            ? MAX_SAMPLE_INTERVAL : threshold / 16 + 1),
+        mutex_(),
+        log_(directory, segmentSize),
+        id_(NextId())
+    {
+    }
+
+    // Returns false when the log is in use and the record could not be
+    // written to it.
+    bool push(const T& value)
+    {
+        bool appended(false);
+        if ((spilling_.load(std::memory_order_acquire) || isDeep())
+            && spill(value, appended))
+        {
+            return appended;
+        }
+        return queue_.push(value);
+    }
+
+    bool pop(T& value)
+    {
+        if (queue_.pop(value))
+        {
+            return true;
+        }
+        if (!spilling_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.pop(value))
+        {
+            return true;
+        }
+        if (log_.pop(value))
+        {
+            return true;
+        }
+        spilling_.store(false, std::memory_order_release);
+        return false;
+    }
+
+    size_t spilled()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return log_.size();
+    }
+
+    bool isEmpty()
+    {
+        return queue_.isEmpty() && !spilled();
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        LockFreeQueue<T, MAX_THREADS, GC_NUM>::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        LockFreeQueue<T, MAX_THREADS, GC_NUM>::ReclaimHazardNodes();
+    }
+};
+
+#endif
@@ -0,0 +1,535 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef WAIT_FREE_QUEUE_H
+#define WAIT_FREE_QUEUE_H
+
+#include "Node.h"
+#include "HazardPointer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+// Kogan-Petrank queue with the fast-path/slow-path split. Operations first
+// try MAX_FAILURES lock-free attempts; after that they publish a descriptor
+// in state_ and every thread with a newer phase helps it to completion, so
+// each operation finishes in a bounded number of steps. A descriptor is one
+// word: the node pointer in the low 48 bits (user space addresses fit on
+// x86-64 and AArch64 Linux), then pending, enqueue and a 14 bit phase.
+// A node is retired after both the dequeue that unlinked it and the one
+// that consumed its value have released it. MAX_FAILURES of 0 sends every
+// operation down the slow path.
+template<typename T, size_t MAX_THREADS, size_t GC_NUM = 0,
+    typename Allocator = std::allocator<T>, size_t MAX_FAILURES = 16>
+class alignas(void*) WaitFreeQueue
+    : private QueueHazardPointerIndex
+{
+public:
+    using Node = node_type::WaitFreeNodeWithHazardPointer<T>;
+    using NodeAllocator = typename std::allocator_traits<
+        Allocator>::template rebind_alloc<Node>;
+
+private:
+    using Hp = QueueHazardPointerOwner<
+        Node, PER_THREAD_HP_NUM, MAX_THREADS * 2, NodeAllocator>;
+
+    enum : size_t { HELPING_DELAY = 32 };
+    enum : uint64_t
+    {
+        POINTER_MASK = (uint64_t(1) << 48) - 1,
+        PENDING = uint64_t(1) << 48,
+        ENQUEUE = uint64_t(1) << 49,
+        PHASE_SHIFT = 50,
+        PHASE_MASK = (uint64_t(1) << 14) - 1
+    };
+
+    struct alignas(64) State
+    {
+        std::atomic<uint64_t> desc_;
+    };
+
+    MsQueue<Node, NodeAllocator> queue_;
+    State state_[MAX_THREADS];
+    alignas(64) std::atomic<uint64_t> phase_;
+
+    static uint64_t Desc(uint64_t phase, bool pending, bool enqueue,
+        Node* node)
+    {
+        return ((phase & PHASE_MASK) << PHASE_SHIFT)
+            | (pending ? uint64_t(PENDING) : 0)
+            | (enqueue ? uint64_t(ENQUEUE) : 0)
+            | (reinterpret_cast<uintptr_t>(node) & POINTER_MASK);
+    }
+
+    static Node* DescNode(uint64_t desc)
+    {
+        return reinterpret_cast<Node*>(desc & POINTER_MASK);
+    }
+
+    static constexpr uint64_t DescPhase(uint64_t desc)
+    {
+        return desc >> PHASE_SHIFT;
+    }
+
+    static constexpr bool IsPending(uint64_t desc, uint64_t phase)
+    {
+        return (desc & PENDING)
+            && ((phase - DescPhase(desc)) & PHASE_MASK) <= PHASE_MASK / 2;
+    }
+
+    static size_t ThreadIndex()
+    {
+        static std::atomic<bool> used[MAX_THREADS];
+        struct Claim
+        {
+            size_t index_;
+
+            Claim()
+                : index_(MAX_THREADS)
+            {
+                for (size_t i = 0; i < MAX_THREADS; ++i)
+                {
+                    bool expected(false);
+                    if (used[i].compare_exchange_strong(expected, true))
+                    {
+                        index_ = i;
+                        return;
+                    }
+                }
+                fprintf(stderr, "WaitFreeQueue get thread index failed\n");
+            }
+            ~Claim()
+            {
+                if (index_ < MAX_THREADS)
+                {
+                    used[index_].store(false);
+                }
+            }
+        };
+        static thread_local Claim claim;
+        return claim.index_;
+    }
+
+    static Node* Protect(const std::atomic<Node*>& source,
+        std::atomic<Node*>& hazard)
+    {
+        Node* node;
+        do
+        {
+            node = source.load(std::memory_order_relaxed);
+            PublishHazard(hazard, node);
+        } while (source.load(std::memory_order_acquire) != node);
+        return node;
+    }
+
+    static void Release(Node* node)
+    {
+        if (node->release_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            Hp::ReclaimLater(node);
+            if (Hp::Length() >= GC_NUM)
+            {
+                Hp::ReclaimLocalHazardNodes();
+            }
+        }
+    }
+
+    bool isStillPending(size_t tid, uint64_t phase) const
+    {
+        return IsPending(state_[tid].desc_.load(), phase);
+    }
+
+    void help(uint64_t phase)
+    {
+        for (size_t tid = 0; tid < MAX_THREADS; ++tid)
+        {
+            const uint64_t desc(state_[tid].desc_.load());
+            if (IsPending(desc, phase))
+            {
+                if (desc & ENQUEUE)
+                {
+                    helpEnqueue(tid, phase);
+                }
+                else
+                {
+                    helpDequeue(tid, phase);
+                }
+            }
+        }
+    }
+
+    void helpStalled(size_t tid)
+    {
+        static thread_local size_t operations(0);
+        static thread_local size_t next(0);
+        if (tid >= MAX_THREADS || ++operations < HELPING_DELAY)
+        {
+            return;
+        }
+        operations = 0;
+        next = (next + 1) % MAX_THREADS;
+        const uint64_t desc(state_[next].desc_.load());
+        if (desc & PENDING)
+        {
+            if (desc & ENQUEUE)
+            {
+                helpEnqueue(next, DescPhase(desc));
+            }
+            else
+            {
+                helpDequeue(next, DescPhase(desc));
+            }
+        }
+    }
+
+    void helpEnqueue(size_t tid, uint64_t phase)
+    {
+        std::atomic<Node*>& hazardLast(Hp::GetHazardPointer(CURRENT));
+        while (isStillPending(tid, phase))
+        {
+            Node* last(Protect(queue_.tail_, hazardLast));
+            Node* next(last->next_.load(std::memory_order_acquire));
+            if (last != queue_.tail_.load())
+            {
+                continue;
+            }
+            if (next)
+            {
+                helpFinishEnqueue();
+                continue;
+            }
+            const uint64_t desc(state_[tid].desc_.load());
+            if (IsPending(desc, phase) && (desc & ENQUEUE)
+                && last->next_.compare_exchange_strong(next, DescNode(desc),
+                    std::memory_order_release,
+                    std::memory_order_relaxed))
+            {
+                helpFinishEnqueue();
+                break;
+            }
+        }
+        hazardLast.store(nullptr, std::memory_order_release);
+    }
+
+    void helpFinishEnqueue()
+    {
+        std::atomic<Node*>& hazardLast(Hp::GetHazardPointer(CURRENT));
+        std::atomic<Node*>& hazardNext(Hp::GetHazardPointer(NEXT));
+        Node* last(Protect(queue_.tail_, hazardLast));
+        Node* next(last->next_.load(std::memory_order_acquire));
+        if (next)
+        {
+            PublishHazard(hazardNext, next);
+            if (last == queue_.tail_.load())
+            {
+                const int tid(next->enqTid_);
+                if (tid >= 0)
+                {
+                    uint64_t desc(state_[tid].desc_.load());
+                    if (last == queue_.tail_.load()
+                        && DescNode(desc) == next)
+                    {
+                        state_[tid].desc_.compare_exchange_strong(desc,
+                            Desc(DescPhase(desc), false, true, next));
+                    }
+                }
+                queue_.tail_.compare_exchange_strong(last, next);
+            }
+            hazardNext.store(nullptr, std::memory_order_release);
+        }
+        hazardLast.store(nullptr, std::memory_order_release);
+    }
+
+    void helpDequeue(size_t tid, uint64_t phase)
+    {
+        std::atomic<Node*>& hazardFirst(Hp::GetHazardPointer(CURRENT));
+        while (isStillPending(tid, phase))
+        {
+            Node* first(Protect(queue_.head_, hazardFirst));
+            Node* last(queue_.tail_.load());
+            Node* next(first->next_.load(std::memory_order_acquire));
+            if (first != queue_.head_.load())
+            {
+                continue;
+            }
+            if (first == last)
+            {
+                if (next)
+                {
+                    helpFinishEnqueue();
+                    continue;
+                }
+                uint64_t desc(state_[tid].desc_.load());
+                if (last == queue_.tail_.load() && IsPending(desc, phase)
+                    && !(desc & ENQUEUE))
+                {
+                    state_[tid].desc_.compare_exchange_strong(desc,
+                        Desc(DescPhase(desc), false, false, nullptr));
+                }
+                continue;
+            }
+            uint64_t desc(state_[tid].desc_.load());
+            if (!IsPending(desc, phase) || (desc & ENQUEUE))
+            {
+                break;
+            }
+            if (first == queue_.head_.load() && DescNode(desc) != first
+                && !state_[tid].desc_.compare_exchange_strong(desc,
+                    Desc(DescPhase(desc), true, false, first)))
+            {
+                continue;
+            }
+            int expected(-1);
+            first->deqTid_.compare_exchange_strong(expected,
+                static_cast<int>(tid));
+            helpFinishDequeue();
+        }
+        hazardFirst.store(nullptr, std::memory_order_release);
+    }
+
+    void helpFinishDequeue()
+    {
+        std::atomic<Node*>& hazardFirst(Hp::GetHazardPointer(CURRENT));
+        Node* first(Protect(queue_.head_, hazardFirst));
+        Node* next(first->next_.load(std::memory_order_acquire));
+        const int tid(first->deqTid_.load());
+        if (tid >= 0)
+        {
+            uint64_t desc(tid < static_cast<int>(MAX_THREADS)
+                ? state_[tid].desc_.load() : 0);
+            if (first == queue_.head_.load() && next)
+            {
+                if (tid < static_cast<int>(MAX_THREADS))
+                {
+                    state_[tid].desc_.compare_exchange_strong(desc,
+                        Desc(DescPhase(desc), false, false,
+                            DescNode(desc)));
+                }
+                queue_.head_.compare_exchange_strong(first, next);
+            }
+        }
+        hazardFirst.store(nullptr, std::memory_order_release);
+    }
+
+    bool tryEnqueue(Node* node)
+    {
+        std::atomic<Node*>& hazardLast(Hp::GetHazardPointer(CURRENT));
+        Node* last(Protect(queue_.tail_, hazardLast));
+        Node* next(last->next_.load(std::memory_order_acquire));
+        bool done(false);
+        if (last == queue_.tail_.load())
+        {
+            if (next)
+            {
+                helpFinishEnqueue();
+            }
+            else if (last->next_.compare_exchange_strong(next, node,
+                std::memory_order_release,
+                std::memory_order_relaxed))
+            {
+                queue_.tail_.compare_exchange_strong(last, node);
+                done = true;
+            }
+        }
+        hazardLast.store(nullptr, std::memory_order_release);
+        return done;
+    }
+
+    // Returns the old head claimed for tid, or nullptr with empty set when
+    // the queue was empty.
+    Node* tryDequeue(size_t tid, bool& empty)
+    {
+        std::atomic<Node*>& hazardFirst(Hp::GetHazardPointer(CURRENT));
+        Node* first(Protect(queue_.head_, hazardFirst));
+        Node* last(queue_.tail_.load());
+        Node* next(first->next_.load(std::memory_order_acquire));
+        Node* claimed(nullptr);
+        if (first == queue_.head_.load())
+        {
+            if (first == last)
+            {
+                if (next)
+                {
+                    helpFinishEnqueue();
+                }
+                else
+                {
+                    empty = true;
+                }
+            }
+            else
+            {
+                int expected(-1);
+                if (first->deqTid_.compare_exchange_strong(expected,
+                    static_cast<int>(tid)))
+                {
+                    claimed = first;
+                }
+                helpFinishDequeue();
+            }
+        }
+        hazardFirst.store(nullptr, std::memory_order_release);
+        return claimed;
+    }
+
+    void enqueue(Node* node)
+    {
+        const size_t tid(ThreadIndex());
+        helpStalled(tid);
+        for (size_t i = 0; tid >= MAX_THREADS || i < MAX_FAILURES; ++i)
+        {
+            if (tryEnqueue(node))
+            {
+                return;
+            }
+        }
+        node->enqTid_ = static_cast<int>(tid);
+        const uint64_t phase(phase_.fetch_add(1) + 1);
+        state_[tid].desc_.store(Desc(phase, true, true, node));
+        help(phase);
+        helpFinishEnqueue();
+    }
+
+    static void Consume(Node* first, T& value)
+    {
+        Node* const next(first->next_.load(std::memory_order_acquire));
+        std::swap(value, next->data_);
+        Release(first);
+        Release(next);
+    }
+
+public:
+    explicit WaitFreeQueue(const WaitFreeQueue&) = delete;
+    const WaitFreeQueue& operator=(const WaitFreeQueue&) = delete;
+
+    WaitFreeQueue()
+        : queue_(),
+        state_(),
+        phase_(0)
+    {
+    }
+
+    ~WaitFreeQueue()
+    {
+        Node* head(queue_.head_.load(std::memory_order_relaxed));
+        while (head)
+        {
+            Node* tmp(head);
+            head = head->next_.load(std::memory_order_relaxed);
+            Reclaim<Node, NodeAllocator>(tmp);
+        }
+    }
+
+    bool push(const T& value)
+    {
+        enqueue(NewNode<Node, NodeAllocator>(value));
+        return true;
+    }
+
+    bool push(T&& value)
+    {
+        enqueue(NewNode<Node, NodeAllocator>(std::move(value)));
+        return true;
+    }
+
+    bool pop(T& value)
+    {
+        const size_t tid(ThreadIndex());
+        helpStalled(tid);
+        for (size_t i = 0; tid >= MAX_THREADS || i < MAX_FAILURES; ++i)
+        {
+            bool empty(false);
+            Node* const first(tryDequeue(tid, empty));
+            if (first)
+            {
+                Consume(first, value);
+                return true;
+            }
+            if (empty)
+            {
+                return false;
+            }
+        }
+        const uint64_t phase(phase_.fetch_add(1) + 1);
+        state_[tid].desc_.store(Desc(phase, true, false, nullptr));
+        help(phase);
+        helpFinishDequeue();
+        Node* const first(DescNode(state_[tid].desc_.load()));
+        if (!first)
+        {
+            return false;
+        }
+        Consume(first, value);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        std::atomic<Node*>& hazardHead(Hp::GetHazardPointer(CURRENT));
+        Node* head(Protect(queue_.head_, hazardHead));
+        const bool empty(!head->next_.load(std::memory_order_acquire));
+        hazardHead.store(nullptr, std::memory_order_release);
+        return empty;
+    }
+
+    static void ReclaimLocalHazardNodes()
+    {
+        Hp::ReclaimLocalHazardNodes();
+    }
+
+    static void ReclaimHazardNodes()
+    {
+        Hp::ReclaimHazardNodes();
+    }
+};
+
+#endif
@@ -0,0 +1,220 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include "Arena.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <set>
+#include <thread>
+#include <vector>
+
+// SlabArena blocks must be distinct, aligned and tagged with a valid home
+// node, a LockFreeQueue over ArenaAllocator must deliver every value once,
+// and nodes freed by a thread's hazard owner after the thread's arena
+// cache is gone must still reach the shared lists for reuse.
+using Queue = LockFreeQueue<int, 16, 64, ArenaAllocator<int> >;
+using LateQueue = LockFreeQueue<int, 16, 1 << 20, ArenaAllocator<int> >;
+
+const int PRODUCERS = 2;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 100000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+const int LATE = 1000;
+
+bool blocks()
+{
+	using Arena = SlabArena<40, 32>;
+	std::set<void*> seen;
+	std::vector<void*> taken;
+	bool ok(true);
+	for (int round = 0; round < 2; ++round)
+	{
+		for (int i = 0; i < 5000; ++i)
+		{
+			void* const block(Arena::Allocate());
+			ok = ok && block && reinterpret_cast<uintptr_t>(block) % 32 == 0
+				&& Arena::HomeNode(block)
+					< NumaTopology::Instance().nodeCount();
+			if (!round)
+			{
+				seen.insert(block);
+			}
+			else
+			{
+				ok = ok && seen.count(block);
+			}
+			taken.push_back(block);
+		}
+		ok = ok && seen.size() == taken.size();
+		for (void* block : taken)
+		{
+			Arena::Release(block);
+		}
+		taken.clear();
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "arena blocks wrong or not reused\n");
+	}
+	return ok;
+}
+
+bool transfer()
+{
+	Queue queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			int value(0);
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					++seen[value];
+					++taken;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			Queue::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	Queue::ReclaimHazardNodes();
+	if (missing || duplicated)
+	{
+		fprintf(stderr, "missing %d duplicated %d\n", missing, duplicated);
+		return false;
+	}
+	return true;
+}
+
+// The worker touches its hazard owner before allocating, so the owner
+// outlives the arena cache and frees the retired nodes on thread exit.
+bool lateRelease()
+{
+	LateQueue queue;
+	std::set<LateQueue::Node*> nodes;
+	std::thread worker([&]() {
+		queue.isEmpty();
+		for (int i = 0; i < LATE; ++i)
+		{
+			LateQueue::Node* const node(
+				NewNode<LateQueue::Node, LateQueue::NodeAllocator>(i));
+			nodes.insert(node);
+			queue.append(node);
+		}
+		int value(0);
+		for (int i = 0; i < LATE; ++i)
+		{
+			queue.pop(value);
+		}
+	});
+	worker.join();
+	LateQueue::ReclaimHazardNodes();
+	if (NumaTopology::Instance().nodeCount() > 1)
+	{
+		return true;
+	}
+	using Arena = SlabArena<sizeof(LateQueue::Node),
+		alignof(LateQueue::Node)>;
+	std::vector<void*> taken;
+	int reused(0);
+	for (int i = 0; i < LATE * 2; ++i)
+	{
+		void* const block(Arena::Allocate());
+		reused += nodes.count(static_cast<LateQueue::Node*>(block)) != 0;
+		taken.push_back(block);
+	}
+	for (void* block : taken)
+	{
+		Arena::Release(block);
+	}
+	// The last node popped stays behind as the queue's dummy.
+	if (reused < LATE - 1)
+	{
+		fprintf(stderr, "late release: reused %d of %d\n", reused, LATE);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(blocks() && transfer() && lateRelease());
+	return ok ? 0 : 1;
+}
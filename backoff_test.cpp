@@ -0,0 +1,189 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include "Backoff.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Every contention manager must leave a LockFreeQueue delivering each
+// value once, and the CAS loops must build one manager per operation and
+// call onSuccess() on it exactly once, however many onFailure() calls
+// came first.
+const int PRODUCERS = 2;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+std::atomic<long> built(0);
+std::atomic<long> succeeded(0);
+std::atomic<long> failed(0);
+std::atomic<long> pops(0);
+
+struct CountingBackoff
+{
+	bool done_;
+
+	CountingBackoff()
+		: done_(false)
+	{
+		++built;
+	}
+
+	void onFailure()
+	{
+		failed += !done_;
+		CpuRelax();
+	}
+
+	void onSuccess()
+	{
+		succeeded += !done_;
+		done_ = true;
+	}
+};
+
+template<typename Backoff>
+bool transfer(const char* name)
+{
+	using Queue = LockFreeQueue<int, 16, 64, std::allocator<int>, Backoff>;
+	built.store(0);
+	succeeded.store(0);
+	failed.store(0);
+	pops.store(0);
+	bool ok(true);
+	{
+		Queue queue;
+		std::vector<std::atomic<int> > seen(TOTAL);
+		std::atomic<int> taken(0);
+		std::vector<std::thread> threads;
+		for (int p = 0; p < PRODUCERS; ++p)
+		{
+			threads.emplace_back([&queue, p]() {
+				for (int i = 0; i < PER_PRODUCER; ++i)
+				{
+					queue.push(p * PER_PRODUCER + i);
+				}
+			});
+		}
+		for (int c = 0; c < CONSUMERS; ++c)
+		{
+			threads.emplace_back([&]() {
+				int value(0);
+				while (taken.load() < TOTAL)
+				{
+					++pops;
+					if (queue.pop(value))
+					{
+						++seen[value];
+						++taken;
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+				Queue::ReclaimLocalHazardNodes();
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		int missing(0);
+		int duplicated(0);
+		for (const auto& count : seen)
+		{
+			missing += count.load() == 0;
+			duplicated += count.load() > 1;
+		}
+		Queue::ReclaimHazardNodes();
+		if (missing || duplicated)
+		{
+			fprintf(stderr, "%s: missing %d duplicated %d\n",
+				name, missing, duplicated);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Counts hold only for CountingBackoff; every push and every pop call,
+// empty or not, runs one CAS loop.
+bool hooks()
+{
+	if (!transfer<CountingBackoff>("counting"))
+	{
+		return false;
+	}
+	const long operations(built.load());
+	if (operations != TOTAL + pops.load()
+		|| succeeded.load() != operations)
+	{
+		fprintf(stderr, "hooks: built %ld succeeded %ld failed %ld\n",
+			operations, succeeded.load(), failed.load());
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(transfer<NoBackoff>("none")
+		&& transfer<PauseBackoff>("pause")
+		&& transfer<ExponentialBackoff<> >("exponential")
+		&& transfer<ExponentialBackoff<1, 2> >("exponential 1..2")
+		&& transfer<AdaptiveBackoff<> >("adaptive")
+		&& hooks());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Bounded LockFreeQueue: tryPush() must stop at capacity and at the byte
+// budget, pops must give the room back, and with producers and consumers
+// racing the accepted but not yet popped elements must never exceed the
+// capacity while every value still comes out exactly once. A consumer
+// counts its pop only after the pop has made room, so each consumer may
+// add one to the observed depth.
+using Queue = LockFreeQueue<int, 16, 64>;
+
+const size_t CAPACITY = 100;
+const int PRODUCERS = 4;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+size_t fill(Queue& queue)
+{
+	size_t accepted(0);
+	while (queue.tryPush(static_cast<int>(accepted)))
+	{
+		++accepted;
+	}
+	return accepted;
+}
+
+bool limits()
+{
+	Queue bounded(CAPACITY);
+	const size_t full(fill(bounded));
+	int value;
+	bounded.pop(value);
+	const bool refilled(bounded.tryPush(0) && !bounded.tryPush(0));
+	// push() ignores the limit; the debt must be paid back by pops first.
+	bounded.push(0);
+	bounded.pop(value);
+	const bool indebted(!bounded.tryPush(0));
+	bounded.pop(value);
+	const bool repaid(bounded.tryPush(0) && !bounded.tryPush(0));
+
+	Queue budget(0, CAPACITY * sizeof(Queue::Node));
+	const size_t budgeted(fill(budget));
+	Queue::ReclaimHazardNodes();
+	if (full != CAPACITY || !refilled || !indebted || !repaid
+		|| budgeted > CAPACITY || budgeted < CAPACITY / 2)
+	{
+		fprintf(stderr, "full %zu refilled %d indebted %d repaid %d "
+			"budgeted %zu\n", full, refilled, indebted, repaid, budgeted);
+		return false;
+	}
+	return true;
+}
+
+bool backpressure()
+{
+	Queue queue(CAPACITY);
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> inQueue(0);
+	std::atomic<int> deepest(0);
+	std::atomic<int> taken(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.pushWait(p * PER_PRODUCER + i);
+				const int depth(++inQueue);
+				int old(deepest.load());
+				while (depth > old && !deepest.compare_exchange_weak(old, depth));
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			int value;
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					--inQueue;
+					++seen[value];
+					++taken;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			Queue::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	const size_t refill(fill(queue));
+	Queue::ReclaimHazardNodes();
+	if (missing || duplicated || deepest.load() > int(CAPACITY) + CONSUMERS
+		|| refill != CAPACITY)
+	{
+		fprintf(stderr, "missing %d duplicated %d deepest %d refill %zu\n",
+			missing, duplicated, deepest.load(), refill);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(limits() && backpressure());
+	return ok ? 0 : 1;
+}
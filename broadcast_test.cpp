@@ -0,0 +1,201 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "BroadcastQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Every subscriber must see every published value once, in each
+// publisher's order, and nodes all subscribers have passed must be freed
+// even when one thread publishes to several queues in turn.
+std::atomic<long> live(0);
+
+template<typename T>
+struct CountingAllocator
+{
+	using value_type = T;
+
+	CountingAllocator() {}
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		live += n;
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* ptr, size_t n)
+	{
+		live -= n;
+		std::allocator<T>().deallocate(ptr, n);
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&)
+{
+	return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&)
+{
+	return false;
+}
+
+using Queue = BroadcastQueue<int, 8, 4, 64, CountingAllocator<int> >;
+
+const int PUBLISHERS = 2;
+const int SUBSCRIBERS = 3;
+const int PER_PUBLISHER = 50000;
+const int TOTAL = PUBLISHERS * PER_PUBLISHER;
+const int ALTERNATE = 100000;
+
+bool fanOut()
+{
+	Queue queue;
+	std::vector<std::unique_ptr<Queue::Subscriber> > subscribers;
+	for (int i = 0; i < SUBSCRIBERS; ++i)
+	{
+		subscribers.emplace_back(new Queue::Subscriber(queue));
+	}
+	std::atomic<int> failures(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PUBLISHERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PUBLISHER; ++i)
+			{
+				queue.push(p * PER_PUBLISHER + i);
+			}
+		});
+	}
+	for (auto& subscriber : subscribers)
+	{
+		Queue::Subscriber* const reader(subscriber.get());
+		threads.emplace_back([reader, &failures]() {
+			std::vector<int> last(PUBLISHERS, -1);
+			int value;
+			for (int received = 0; received < TOTAL;)
+			{
+				if (!reader->pop(value))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				++received;
+				const int publisher(value / PER_PUBLISHER);
+				if (value % PER_PUBLISHER != last[publisher] + 1)
+				{
+					++failures;
+				}
+				last[publisher] = value % PER_PUBLISHER;
+			}
+			if (reader->pop(value))
+			{
+				++failures;
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	if (!subscribers.front()->isValid() || failures.load())
+	{
+		fprintf(stderr, "fan out failures %d\n", failures.load());
+		return false;
+	}
+	return true;
+}
+
+// Subscribers keep up, so only the nodes since the last reclaim of each
+// queue may stay allocated.
+bool alternate()
+{
+	Queue first;
+	Queue second;
+	Queue::Subscriber firstReader(first);
+	Queue::Subscriber secondReader(second);
+	long deepest(0);
+	int value(0);
+	for (int i = 0; i < ALTERNATE; ++i)
+	{
+		first.push(i);
+		second.push(i);
+		firstReader.pop(value);
+		secondReader.pop(value);
+		deepest = live.load() > deepest ? live.load() : deepest;
+	}
+	Queue::ReclaimHazardNodes();
+	if (deepest > 4 * 64 + 2)
+	{
+		fprintf(stderr, "alternate: %ld nodes live\n", deepest);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(fanOut() && alternate());
+	Queue::ReclaimHazardNodes();
+	if (live.load())
+	{
+		fprintf(stderr, "%ld nodes leaked\n", live.load());
+		return 1;
+	}
+	return ok ? 0 : 1;
+}
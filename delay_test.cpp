@@ -0,0 +1,178 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "DelayQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Producers schedule short timers and cancel every third one while a
+// consumer pops; every uncancelled timer must fire exactly once and the
+// small pool must come back whole.
+using Queue = DelayQueue<int, 8, 64>;
+
+const size_t CAPACITY = 256;
+const int PRODUCERS = 3;
+const int PER_PRODUCER = 20000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+void produce(Queue& queue, int producer, std::vector<char>& cancelled)
+{
+	for (int i = 0; i < PER_PRODUCER; ++i)
+	{
+		const int id(producer * PER_PRODUCER + i);
+		Queue::Handle handle;
+		while (!(handle = queue.pushAfter(id,
+			std::chrono::microseconds(i % 500))))
+		{
+			queue.advance();
+			std::this_thread::yield();
+		}
+		if (i % 3 == 0 && queue.cancel(handle))
+		{
+			cancelled[id] = 1;
+		}
+	}
+}
+
+void consume(Queue& queue, std::vector<std::atomic<int> >& fired,
+	std::atomic<bool>& producing)
+{
+	int value;
+	while (producing.load() || !queue.isEmpty())
+	{
+		if (queue.pop(value))
+		{
+			++fired[value];
+		}
+	}
+	Queue::ReclaimLocalHazardNodes();
+}
+
+// A cancelled timer has to give its pool slot back on the next advance,
+// long before its deadline.
+bool cancelReusesPool()
+{
+	Queue queue(4);
+	for (int i = 0; i < 10; ++i)
+	{
+		const Queue::Handle handle(queue.pushAfter(i,
+			std::chrono::seconds(10)));
+		if (!handle)
+		{
+			fprintf(stderr, "pool exhausted after %d cancels\n", i);
+			return false;
+		}
+		queue.advance();
+		if (!queue.cancel(handle))
+		{
+			fprintf(stderr, "cancel %d failed\n", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	if (!cancelReusesPool())
+	{
+		return 1;
+	}
+	Queue queue(CAPACITY, std::chrono::microseconds(100));
+	std::vector<std::atomic<int> > fired(TOTAL);
+	std::vector<char> cancelled(TOTAL, 0);
+	std::atomic<bool> producing(true);
+	std::thread consumer([&]() { consume(queue, fired, producing); });
+	std::vector<std::thread> producers;
+	for (int i = 0; i < PRODUCERS; ++i)
+	{
+		producers.emplace_back([&queue, &cancelled, i]()
+			{
+				produce(queue, i, cancelled);
+			});
+	}
+	for (auto& producer : producers)
+	{
+		producer.join();
+	}
+	const auto end(Queue::Clock::now() + std::chrono::milliseconds(50));
+	while (Queue::Clock::now() < end)
+	{
+		queue.advance();
+	}
+	producing = false;
+	consumer.join();
+	int value;
+	while (queue.pop(value))
+	{
+		++fired[value];
+	}
+	int wrong(0);
+	for (int i = 0; i < TOTAL; ++i)
+	{
+		wrong += fired[i].load() != (cancelled[i] ? 0 : 1);
+	}
+	size_t free(0);
+	while (queue.pushAfter(0, std::chrono::seconds(10)))
+	{
+		++free;
+	}
+	Queue::ReclaimHazardNodes();
+	if (wrong || free != CAPACITY)
+	{
+		fprintf(stderr, "wrong %d free %zu\n", wrong, free);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// drain() and spliceFrom() racing producers and consumers: every value
+// must come out exactly once, through pop(), drain() or the spliced queue.
+using Queue = LockFreeQueue<int, 16, 64>;
+
+const int PRODUCERS = 3;
+const int PER_PRODUCER = 100000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+void push(Queue& queue, int producer)
+{
+	for (int i = 0; i < PER_PRODUCER; ++i)
+	{
+		queue.push(producer * PER_PRODUCER + i);
+	}
+}
+
+void pop(Queue& queue, std::vector<std::atomic<int> >& seen,
+	std::atomic<int>& taken)
+{
+	int value;
+	while (taken.load() < TOTAL)
+	{
+		if (queue.pop(value))
+		{
+			++seen[value];
+			++taken;
+		}
+	}
+	Queue::ReclaimLocalHazardNodes();
+}
+
+void drain(Queue& queue, std::vector<std::atomic<int> >& seen,
+	std::atomic<int>& taken, std::atomic<int>& mismatch)
+{
+	while (taken.load() < TOTAL)
+	{
+		Queue::Chained chain;
+		const size_t count(queue.drain(chain));
+		size_t walked(0);
+		Queue::Node* node(chain.moveHead());
+		Queue::Node* const tail(chain.moveTail());
+		while (node)
+		{
+			Queue::Node* const next(node == tail
+				? nullptr : node->next_.load(std::memory_order_relaxed));
+			++seen[node->data_];
+			++walked;
+			Reclaim<Queue::Node, Queue::NodeAllocator>(node);
+			node = next;
+		}
+		if (walked != count)
+		{
+			++mismatch;
+		}
+		taken += static_cast<int>(walked);
+		std::this_thread::yield();
+	}
+}
+
+void splice(Queue& target, Queue& source, std::atomic<int>& taken)
+{
+	while (taken.load() < TOTAL)
+	{
+		target.spliceFrom(source);
+		std::this_thread::yield();
+	}
+}
+
+int main()
+{
+	Queue source;
+	Queue target;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::atomic<int> mismatch(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < PRODUCERS; ++i)
+	{
+		threads.emplace_back([&source, i]() { push(source, i); });
+	}
+	threads.emplace_back([&]() { pop(source, seen, taken); });
+	threads.emplace_back([&]() { pop(target, seen, taken); });
+	threads.emplace_back([&]() { drain(source, seen, taken, mismatch); });
+	threads.emplace_back([&]() { drain(target, seen, taken, mismatch); });
+	threads.emplace_back([&]() { splice(target, source, taken); });
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	const bool empty(source.isEmpty() && target.isEmpty()
+		&& !source.size() && !target.size());
+	Queue::ReclaimHazardNodes();
+	if (missing || duplicated || mismatch.load() || !empty)
+	{
+		fprintf(stderr, "missing %d duplicated %d mismatch %d empty %d\n",
+			missing, duplicated, mismatch.load(), empty);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,173 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "EventQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <thread>
+#include <vector>
+
+// The eventfd must be readable exactly while values wait, and an epoll
+// consumer racing bursty producers must never sleep through a push: a
+// wait that times out with values still queued is a lost wakeup.
+using Queue = EventQueue<int, 8, 64>;
+using Inner = LockFreeQueue<int, 8, 64>;
+
+const int PRODUCERS = 3;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+const int BULK = 64;
+const int TIMEOUT_MS = 5000;
+
+bool readable(const Queue& queue)
+{
+	pollfd fd{ queue.fd(), POLLIN, 0 };
+	return poll(&fd, 1, 0) == 1 && (fd.revents & POLLIN);
+}
+
+bool readiness()
+{
+	Queue queue;
+	bool ok(queue.fd() >= 0 && !readable(queue));
+	queue.push(1);
+	queue.push(2);
+	ok = ok && readable(queue);
+	int values[BULK];
+	ok = ok && queue.popBulk(values, 1) == 1 && readable(queue);
+	ok = ok && queue.popBulk(values, BULK) == 1 && values[0] == 2;
+	ok = ok && !readable(queue) && queue.isEmpty();
+	queue.push(3);
+	ok = ok && readable(queue);
+	ok = ok && queue.popBulk(values, BULK) == 1 && !readable(queue);
+	Inner::ReclaimHazardNodes();
+	if (!ok)
+	{
+		fprintf(stderr, "eventfd readiness wrong\n");
+	}
+	return ok;
+}
+
+bool epollLoop()
+{
+	Queue queue;
+	const int epoll(epoll_create1(EPOLL_CLOEXEC));
+	epoll_event event{};
+	event.events = EPOLLIN;
+	if (epoll < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, queue.fd(), &event))
+	{
+		fprintf(stderr, "epoll setup failed\n");
+		return false;
+	}
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(p * PER_PRODUCER + i);
+				if (i % 1000 == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	std::vector<int> seen(TOTAL);
+	std::vector<int> last(PRODUCERS, -1);
+	int received(0);
+	int disorder(0);
+	bool lost(false);
+	int values[BULK];
+	while (received < TOTAL && !lost)
+	{
+		epoll_event ready;
+		if (epoll_wait(epoll, &ready, 1, TIMEOUT_MS) != 1)
+		{
+			lost = true;
+			break;
+		}
+		const size_t count(queue.popBulk(values, BULK));
+		for (size_t i = 0; i < count; ++i)
+		{
+			const int producer(values[i] / PER_PRODUCER);
+			disorder += values[i] <= last[producer];
+			last[producer] = values[i];
+			++seen[values[i]];
+		}
+		received += static_cast<int>(count);
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	close(epoll);
+	int missing(0);
+	for (const auto count : seen)
+	{
+		missing += count != 1;
+	}
+	Inner::ReclaimHazardNodes();
+	if (lost || disorder || missing)
+	{
+		fprintf(stderr, "lost %d disorder %d missing %d\n",
+			lost, disorder, missing);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(readiness() && epollLoop());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#define HAZARD_POINTER_ASYMMETRIC_FENCE
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// LockFreeQueue built with asymmetric fences: hazard publication is a
+// plain release store and every scan issues membarrier(), or both sides
+// fall back to full fences when registration fails. Scanning after every
+// pop makes reclamation race publication as often as possible; a node
+// freed while still protected shows up as a lost or repeated value, or
+// under ASan as a use after free.
+using Queue = LockFreeQueue<int, 16, 1>;
+
+const int PRODUCERS = 3;
+const int CONSUMERS = 3;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+int main()
+{
+	const bool registered(AsymmetricFence::Register());
+	Queue queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			int value(0);
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					++seen[value];
+					++taken;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	const bool empty(queue.isEmpty());
+	Queue::ReclaimHazardNodes();
+	if (missing || duplicated || !empty)
+	{
+		fprintf(stderr, "registered %d missing %d duplicated %d empty %d\n",
+			registered, missing, duplicated, empty);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,231 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "HazardDomain.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// A protected object must survive reclaim() until its holder lets go,
+// stateless and capturing deleters must both run exactly once, retired()
+// must count what is still waiting, the threshold must trigger reclaim()
+// on its own, and readers racing with writers must never see a freed
+// object.
+const int READERS = 2;
+const int WRITERS = 2;
+const int SWAPS = 20000;
+const unsigned LIVE = 0x600dc0de;
+
+struct Object
+{
+	std::atomic<unsigned> state_;
+	int value_;
+
+	explicit Object(int value)
+		: state_(LIVE),
+		value_(value)
+	{
+	}
+
+	~Object()
+	{
+		state_.store(0);
+	}
+};
+
+std::atomic<int> deleted(0);
+
+struct CountingDeleter
+{
+	void operator()(Object* object) const
+	{
+		delete object;
+		++deleted;
+	}
+};
+
+bool protection()
+{
+	deleted.store(0);
+	HazardDomain domain(1 << 20);
+	std::atomic<Object*> source(new Object(1));
+	HazardHolder holder(domain);
+	Object* const protectedObject(holder.protect(source));
+	source.store(new Object(2));
+	domain.retire(protectedObject, CountingDeleter());
+	domain.reclaim();
+	bool ok(deleted.load() == 0 && domain.retired() == 1
+		&& protectedObject->state_.load() == LIVE
+		&& protectedObject->value_ == 1);
+	holder.reset();
+	domain.reclaim();
+	ok = ok && deleted.load() == 1 && domain.retired() == 0;
+	domain.retire(source.exchange(nullptr), CountingDeleter());
+	ok = ok && domain.retired() == 1;
+	if (!ok)
+	{
+		fprintf(stderr, "protection: deleted %d retired %zu\n",
+			deleted.load(), domain.retired());
+	}
+	return ok;
+}
+
+bool deleters()
+{
+	int captured(0);
+	{
+		HazardDomain domain(1 << 20);
+		domain.retire(new Object(1), [](Object* object) {
+			delete object;
+			++deleted;
+		});
+		domain.retire(new Object(2), [&captured](Object* object) {
+			captured += object->value_;
+			delete object;
+		});
+		domain.retire(static_cast<Object*>(nullptr), CountingDeleter());
+		if (domain.retired() != 2)
+		{
+			fprintf(stderr, "deleters: retired %zu\n", domain.retired());
+			return false;
+		}
+		deleted.store(0);
+		domain.reclaim();
+	}
+	if (deleted.load() != 1 || captured != 2)
+	{
+		fprintf(stderr, "deleters: deleted %d captured %d\n",
+			deleted.load(), captured);
+		return false;
+	}
+	return true;
+}
+
+// Every retire() lands on this thread's shard, so the shard reaching the
+// threshold frees the lot without an explicit reclaim().
+bool threshold()
+{
+	deleted.store(0);
+	HazardDomain domain(8);
+	for (int i = 0; i < 8; ++i)
+	{
+		domain.retire(new Object(i), CountingDeleter());
+	}
+	if (deleted.load() != 8 || domain.retired() != 0)
+	{
+		fprintf(stderr, "threshold: deleted %d retired %zu\n",
+			deleted.load(), domain.retired());
+		return false;
+	}
+	return true;
+}
+
+bool concurrent()
+{
+	deleted.store(0);
+	HazardDomain domain(64);
+	std::atomic<Object*> source(new Object(0));
+	std::atomic<int> writing(WRITERS);
+	std::atomic<int> corrupt(0);
+	std::vector<std::thread> threads;
+	for (int r = 0; r < READERS; ++r)
+	{
+		threads.emplace_back([&]() {
+			HazardHolder holder(domain);
+			while (writing.load())
+			{
+				const Object* const object(holder.protect(source));
+				if (object->state_.load() != LIVE || object->value_ < 0)
+				{
+					++corrupt;
+				}
+				holder.reset();
+			}
+		});
+	}
+	for (int w = 0; w < WRITERS; ++w)
+	{
+		threads.emplace_back([&, w]() {
+			for (int i = 0; i < SWAPS; ++i)
+			{
+				domain.retire(source.exchange(new Object(w * SWAPS + i)),
+					CountingDeleter());
+				if (i % 64 == 0)
+				{
+					std::this_thread::yield();
+				}
+			}
+			--writing;
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	domain.retire(source.exchange(nullptr), CountingDeleter());
+	domain.reclaim();
+	if (corrupt.load() || deleted.load() != WRITERS * SWAPS + 1
+		|| domain.retired() != 0)
+	{
+		fprintf(stderr, "concurrent: corrupt %d deleted %d retired %zu\n",
+			corrupt.load(), deleted.load(), domain.retired());
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(protection() && deleters() && threshold()
+		&& concurrent());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "IntrusiveQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// User objects pushed from several threads must each be read once, in
+// producer order, and every one of them must reach the Disposer exactly
+// once: after being unlinked and unprotected, or when the queue dies.
+std::atomic<int> disposed(0);
+
+struct Message : node_type::IntrusiveHook<Message>
+{
+	int value_;
+
+	Message() : value_(-1) {}
+	explicit Message(int value) : value_(value) {}
+};
+
+struct CountingDisposer
+{
+	void operator()(Message* message) const
+	{
+		++disposed;
+		delete message;
+	}
+};
+
+using Queue = IntrusiveQueue<Message, 8, 64, CountingDisposer>;
+
+const int PRODUCERS = 3;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+bool transfer()
+{
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::atomic<int> disorder(0);
+	{
+		Queue queue;
+		std::vector<std::thread> threads;
+		for (int p = 0; p < PRODUCERS; ++p)
+		{
+			threads.emplace_back([&queue, p]() {
+				for (int i = 0; i < PER_PRODUCER; ++i)
+				{
+					queue.push(new Message(p * PER_PRODUCER + i));
+				}
+			});
+		}
+		for (int c = 0; c < CONSUMERS; ++c)
+		{
+			threads.emplace_back([&]() {
+				std::vector<int> last(PRODUCERS, -1);
+				while (taken.load() < TOTAL)
+				{
+					if (!queue.popWith([&](const Message& message) {
+						const int producer(message.value_ / PER_PRODUCER);
+						disorder += message.value_ <= last[producer];
+						last[producer] = message.value_;
+						++seen[message.value_];
+					}))
+					{
+						std::this_thread::yield();
+						continue;
+					}
+					++taken;
+				}
+				Queue::ReclaimLocalHazardNodes();
+			});
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		if (!queue.isEmpty() || queue.push(nullptr))
+		{
+			++disorder;
+		}
+		// Still queued when the queue dies, so the destructor disposes it.
+		queue.push(new Message(0));
+	}
+	Queue::ReclaimHazardNodes();
+	int missing(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() != 1;
+	}
+	if (missing || disorder.load() || disposed.load() != TOTAL + 1)
+	{
+		fprintf(stderr, "missing %d disorder %d disposed %d of %d\n",
+			missing, disorder.load(), disposed.load(), TOTAL + 1);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	return transfer() ? 0 : 1;
+}
@@ -0,0 +1,234 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include "NumaLockFreeQueue.h"
+#include "Arena.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+enum { THREADS = 4, COUNT = 1000000, DEEP = 4000000 };
+
+int openTlbCounter()
+{
+	perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB
+		| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+void pin(size_t index)
+{
+	const std::vector<int>& cpus(
+		NumaTopology::Instance().cpusOfNode(index));
+	if (cpus.empty())
+	{
+		return;
+	}
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (const auto cpu : cpus)
+	{
+		CPU_SET(cpu, &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+template<typename Queue>
+double run(Queue& queue, const std::function<void()>& done,
+	size_t pairs = THREADS)
+{
+	std::vector<std::thread> threads;
+	const int count(COUNT / pairs);
+	const auto start(std::chrono::steady_clock::now());
+	for (size_t t = 0; t < pairs; ++t)
+	{
+		threads.emplace_back([&queue, count, t]() {
+			pin(t);
+			for (int i = 0; i < count; ++i)
+			{
+				queue.push(i);
+			}
+		});
+		threads.emplace_back([&queue, &done, count, t]() {
+			pin(t + 1);
+			int n(0);
+			for (int i = 0; i < count; ++i)
+			{
+				while (!queue.pop(n));
+			}
+			done();
+			Queue::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	const std::chrono::duration<double> elapsed(
+		std::chrono::steady_clock::now() - start);
+	Queue::ReclaimHazardNodes();
+	return count * pairs / elapsed.count() / 1e6;
+}
+
+template<typename Backoff>
+void contention(const char* name)
+{
+	fprintf(stdout, "%-30s", name);
+	for (size_t pairs = 1; pairs <= THREADS * 2; pairs *= 2)
+	{
+		LockFreeQueue<int, THREADS * 8, 2048, std::allocator<int>,
+			Backoff> queue;
+		fprintf(stdout, " %8.2f", run(queue, []() {}, pairs));
+		fflush(stdout);
+	}
+	fprintf(stdout, "\n");
+}
+
+template<typename Queue>
+void deep(const char* name)
+{
+	Queue queue;
+	const int fd(openTlbCounter());
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	const auto start(std::chrono::steady_clock::now());
+	for (int i = 0; i < DEEP; ++i)
+	{
+		queue.push(i);
+	}
+	int n(0);
+	for (int i = 0; i < DEEP; ++i)
+	{
+		queue.pop(n);
+	}
+	const std::chrono::duration<double> elapsed(
+		std::chrono::steady_clock::now() - start);
+	long long misses(-1);
+	if (fd >= 0)
+	{
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+		{
+			misses = -1;
+		}
+		close(fd);
+	}
+	Queue::ReclaimHazardNodes();
+	if (misses < 0)
+	{
+		fprintf(stdout, "%-30s %8.2f Mops/s  dTLB misses n/a\n",
+			name, 2.0 * DEEP / elapsed.count() / 1e6);
+	}
+	else
+	{
+		fprintf(stdout, "%-30s %8.2f Mops/s  dTLB misses %lld\n",
+			name, 2.0 * DEEP / elapsed.count() / 1e6, misses);
+	}
+}
+
+int main()
+{
+	fprintf(stdout, "numa nodes: %zu\n",
+		NumaTopology::Instance().nodeCount());
+	{
+		LockFreeQueue<int, THREADS * 2, 2048> queue;
+		const double mops(run(queue, []() {}));
+		fprintf(stdout, "LockFreeQueue       %8.2f Mops/s\n", mops);
+	}
+	{
+		using Queue = NumaLockFreeQueue<int, THREADS * 2, 2048>;
+		std::atomic<size_t> local(0);
+		std::atomic<size_t> remote(0);
+		Queue queue;
+		const double mops(run(queue, [&local, &remote]() {
+			local += Queue::PopStats().local_;
+			remote += Queue::PopStats().remote_;
+		}));
+		fprintf(stdout, "NumaLockFreeQueue   %8.2f Mops/s"
+			"  local pops %zu  cross-socket pops %zu\n",
+			mops, local.load(), remote.load());
+	}
+	deep<LockFreeQueue<int, THREADS * 2, 2048> >(
+		"deep, std::allocator");
+	deep<LockFreeQueue<int, THREADS * 2, 2048, ArenaAllocator<int> > >(
+		"deep, ArenaAllocator");
+	fprintf(stdout, "%-30s", "Mops/s by producer/consumer pairs");
+	for (size_t pairs = 1; pairs <= THREADS * 2; pairs *= 2)
+	{
+		fprintf(stdout, " %8zu", pairs);
+	}
+	fprintf(stdout, "\n");
+	contention<NoBackoff>("NoBackoff");
+	contention<PauseBackoff>("PauseBackoff");
+	contention<ExponentialBackoff<> >("ExponentialBackoff");
+	contention<AdaptiveBackoff<> >("AdaptiveBackoff");
+}
@@ -50,6 +50,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "LockFreeQueue.h"
+#include <cstdio>
 #include <thread>
 #include <functional>
 
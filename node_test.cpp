@@ -0,0 +1,149 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Nodes carry no retire link, so a queue of int uses two-word nodes.
+// Retired nodes live in per-thread arrays; whatever a thread still holds
+// when it exits is handed to the domain as an orphan batch, and after
+// ReclaimHazardNodes() only the queue's own dummy node may be left.
+static_assert(sizeof(node_type::NodeWithHazardPointer<int>)
+	== 2 * sizeof(void*), "queue link is the only link in a node");
+static_assert(sizeof(node_type::IntrusiveHook<int>)
+	<= 2 * sizeof(void*), "intrusive hook carries no retire link");
+
+std::atomic<long> live(0);
+
+template<typename T>
+struct CountingAllocator
+{
+	using value_type = T;
+
+	CountingAllocator() {}
+	template<typename U>
+	CountingAllocator(const CountingAllocator<U>&) {}
+
+	T* allocate(size_t n)
+	{
+		live += n;
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* ptr, size_t n)
+	{
+		live -= n;
+		std::allocator<T>().deallocate(ptr, n);
+	}
+};
+
+template<typename T, typename U>
+bool operator==(const CountingAllocator<T>&, const CountingAllocator<U>&)
+{
+	return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const CountingAllocator<T>&, const CountingAllocator<U>&)
+{
+	return false;
+}
+
+using Queue = LockFreeQueue<int, 16, 1 << 20, CountingAllocator<int> >;
+
+const int ROUNDS = 20;
+const int WORKERS = 4;
+const int PER_WORKER = 2000;
+
+int main()
+{
+	bool ok(true);
+	{
+		Queue queue;
+		for (int round = 0; round < ROUNDS; ++round)
+		{
+			// Workers exit with every node they popped still retired
+			// while the others keep publishing hazards.
+			std::vector<std::thread> workers;
+			for (int w = 0; w < WORKERS; ++w)
+			{
+				workers.emplace_back([&queue]() {
+					int value(0);
+					for (int i = 0; i < PER_WORKER; ++i)
+					{
+						queue.push(i);
+						queue.pop(value);
+					}
+				});
+			}
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+		}
+		Queue::ReclaimHazardNodes();
+		ok = queue.isEmpty() && live.load() == 1;
+		if (!ok)
+		{
+			fprintf(stderr, "%ld nodes live after reclaim\n", live.load());
+		}
+	}
+	if (live.load())
+	{
+		fprintf(stderr, "%ld nodes leaked\n", live.load());
+		ok = false;
+	}
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "NumaLockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// The topology must describe at least one node holding the calling cpu,
+// node memory must be usable, and every value pushed through the per-node
+// lanes must come out exactly once.
+using Queue = NumaLockFreeQueue<int, 16, 64>;
+using RotatingQueue = NumaLockFreeQueue<int, 16, 64, false>;
+
+const int PRODUCERS = 4;
+const int PER_PRODUCER = 100000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+bool topology()
+{
+	const NumaTopology& topology(NumaTopology::Instance());
+	const size_t nodes(topology.nodeCount());
+	if (!nodes || nodes > NUMA_MAX_NODES
+		|| NumaTopology::CurrentNode() >= nodes)
+	{
+		fprintf(stderr, "nodes %zu current %zu\n",
+			nodes, NumaTopology::CurrentNode());
+		return false;
+	}
+	for (size_t node = 0; node < nodes; ++node)
+	{
+		const size_t size(NumaPageSize() * 2 + 1);
+		char* const memory(static_cast<char*>(NumaAlloc(size, node)));
+		if (!memory)
+		{
+			fprintf(stderr, "NumaAlloc on node %zu failed\n", node);
+			return false;
+		}
+		memset(memory, 0x5a, size);
+		NumaFree(memory, size);
+		for (const auto cpu : topology.cpusOfNode(node))
+		{
+			if (topology.nodeOfCpu(cpu) != node)
+			{
+				fprintf(stderr, "cpu %d not on node %zu\n", cpu, node);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+template<typename Q>
+bool transfer(const char* name)
+{
+	Q queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::atomic<size_t> popped(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < PRODUCERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			const NumaPopStats before(Q::PopStats());
+			int value;
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					++seen[value];
+					++taken;
+				}
+			}
+			popped += Q::PopStats().local_ + Q::PopStats().remote_
+				- before.local_ - before.remote_;
+			Q::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	int value;
+	const bool empty(queue.isEmpty() && !queue.pop(value));
+	Q::ReclaimHazardNodes();
+	if (missing || duplicated || popped.load() != size_t(TOTAL) || !empty)
+	{
+		fprintf(stderr, "%s: missing %d duplicated %d popped %zu empty %d\n",
+			name, missing, duplicated, popped.load(), empty);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(topology()
+		&& transfer<Queue>("local")
+		&& transfer<RotatingQueue>("rotating"));
+	return ok ? 0 : 1;
+}
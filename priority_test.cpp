@@ -0,0 +1,195 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PriorityLaneQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Strict levels must drain the most urgent level first, FIFO within a
+// level. Weighted levels must split pops by their weights, also when one
+// thread pops two queues in turn. Under concurrency every value must come
+// out once and in order per producer and level.
+using Strict = PriorityLaneQueue<int, 4, 8>;
+using Weighted = PriorityLaneQueue<int, 2, 8, 0, true>;
+using Shared = PriorityLaneQueue<int, 3, 16, 64>;
+
+const int PRODUCERS = 3;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 60000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+bool strict()
+{
+	Strict queue;
+	for (int i = 0; i < 40; ++i)
+	{
+		queue.push(3 - i % 4, i);
+	}
+	bool ok(!queue.push(4, 0));
+	int value(0);
+	int previous(-1);
+	for (int i = 0; i < 40; ++i)
+	{
+		ok = ok && queue.pop(value);
+		// Level 3 - value % 4 ascends, values ascend within a level.
+		const int key((3 - value % 4) * 100 + value);
+		ok = ok && key > previous;
+		previous = key;
+	}
+	ok = ok && !queue.pop(value) && queue.isEmpty();
+	Strict::ReclaimHazardNodes();
+	if (!ok)
+	{
+		fprintf(stderr, "strict order broken\n");
+	}
+	return ok;
+}
+
+bool weighted()
+{
+	const size_t weights[2] = { 3, 1 };
+	Weighted first(weights);
+	Weighted second(weights);
+	for (int i = 0; i < 20; ++i)
+	{
+		first.push(0, 0);
+		first.push(1, 1);
+		second.push(0, 0);
+		second.push(1, 1);
+	}
+	int levels[2][2] = {};
+	int value(0);
+	for (int i = 0; i < 20; ++i)
+	{
+		first.pop(value);
+		++levels[0][value];
+		second.pop(value);
+		++levels[1][value];
+	}
+	Weighted::ReclaimHazardNodes();
+	for (const auto& split : levels)
+	{
+		if (split[0] != 15 || split[1] != 5)
+		{
+			fprintf(stderr, "weighted split %d:%d\n", split[0], split[1]);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool concurrent()
+{
+	Shared queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::atomic<int> disorder(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(i % 3, p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			std::vector<int> last(PRODUCERS * 3, -1);
+			int value(0);
+			while (taken.load() < TOTAL)
+			{
+				if (!queue.pop(value))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				++seen[value];
+				++taken;
+				const int lane(value / PER_PRODUCER * 3
+					+ value % PER_PRODUCER % 3);
+				disorder += value <= last[lane];
+				last[lane] = value;
+			}
+			Shared::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	const bool empty(queue.isEmpty());
+	Shared::ReclaimHazardNodes();
+	if (missing || duplicated || disorder.load() || !empty)
+	{
+		fprintf(stderr, "missing %d duplicated %d disorder %d empty %d\n",
+			missing, duplicated, disorder.load(), empty);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(strict() && weighted() && concurrent());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ShmQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Producer and consumer processes sharing one ShmQueue. In the first run
+// consumers drop and recreate their Owner every few records, so retired
+// nodes still protected by other processes keep being handed over as
+// orphans. In the second every process keeps one Owner for its whole life
+// on a queue smaller than the default retire batch, so producers depend on
+// consumers scanning their own retired nodes back to the free list.
+struct Record
+{
+	int producer_;
+	int sequence_;
+};
+
+const int PRODUCERS = 3;
+const int CONSUMERS = 3;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+const int STALL_SECONDS = 10;
+
+struct Shared
+{
+	std::atomic<int> consumed_;
+	std::atomic<int> disorder_;
+	std::atomic<int> stalled_;
+	std::atomic<int> seen_[TOTAL];
+};
+
+bool stalled(Shared& shared, std::chrono::steady_clock::time_point since)
+{
+	if (std::chrono::steady_clock::now() - since
+		> std::chrono::seconds(STALL_SECONDS))
+	{
+		shared.stalled_.store(1);
+	}
+	return shared.stalled_.load() != 0;
+}
+
+template<typename Queue>
+void produce(const char* name, Shared& shared, int producer)
+{
+	Queue queue(name, 0);
+	typename Queue::Owner owner(queue);
+	if (!owner.isValid())
+	{
+		_exit(1);
+	}
+	for (int i = 0; i < PER_PRODUCER; ++i)
+	{
+		const auto since(std::chrono::steady_clock::now());
+		while (!owner.push(Record{ producer, i }))
+		{
+			if (stalled(shared, since))
+			{
+				_exit(2);
+			}
+			sched_yield();
+		}
+	}
+}
+
+// ownerBatch of 0 keeps a single Owner.
+template<typename Queue>
+void consume(const char* name, Shared& shared, int ownerBatch)
+{
+	Queue queue(name, 0);
+	int last[PRODUCERS];
+	for (int i = 0; i < PRODUCERS; ++i)
+	{
+		last[i] = -1;
+	}
+	while (shared.consumed_.load() < TOTAL)
+	{
+		typename Queue::Owner owner(queue);
+		if (!owner.isValid())
+		{
+			_exit(1);
+		}
+		auto since(std::chrono::steady_clock::now());
+		for (int i = 0; (!ownerBatch || i < ownerBatch)
+			&& shared.consumed_.load() < TOTAL;)
+		{
+			Record record;
+			if (!owner.pop(record))
+			{
+				if (stalled(shared, since))
+				{
+					_exit(2);
+				}
+				sched_yield();
+				continue;
+			}
+			since = std::chrono::steady_clock::now();
+			++i;
+			++shared.consumed_;
+			++shared.seen_[record.producer_ * PER_PRODUCER
+				+ record.sequence_];
+			if (record.sequence_ <= last[record.producer_])
+			{
+				++shared.disorder_;
+			}
+			last[record.producer_] = record.sequence_;
+		}
+	}
+}
+
+template<typename Queue>
+bool run(const char* test, size_t capacity, int ownerBatch)
+{
+	const std::string name("/lf_shm_test_" + std::to_string(getpid()));
+	Queue::Unlink(name.c_str());
+	Queue queue(name.c_str(), capacity);
+	if (!queue.isValid())
+	{
+		fprintf(stderr, "create %s failed\n", name.c_str());
+		return false;
+	}
+	void* memory(mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+	if (memory == MAP_FAILED)
+	{
+		Queue::Unlink(name.c_str());
+		return false;
+	}
+	Shared& shared(*new (memory) Shared());
+	for (int i = 0; i < PRODUCERS + CONSUMERS; ++i)
+	{
+		const pid_t pid(fork());
+		if (pid == 0)
+		{
+			if (i < PRODUCERS)
+			{
+				produce<Queue>(name.c_str(), shared, i);
+			}
+			else
+			{
+				consume<Queue>(name.c_str(), shared, ownerBatch);
+			}
+			_exit(0);
+		}
+	}
+	int failed(0);
+	int status;
+	while (wait(&status) > 0)
+	{
+		failed += !WIFEXITED(status) || WEXITSTATUS(status);
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : shared.seen_)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	size_t free(0);
+	{
+		typename Queue::Owner owner(queue);
+		while (owner.push(Record{ 0, 0 }))
+		{
+			++free;
+		}
+	}
+	Queue::Unlink(name.c_str());
+	const bool ok(!failed && !missing && !duplicated
+		&& !shared.disorder_.load() && !shared.stalled_.load()
+		&& free == capacity);
+	if (!ok)
+	{
+		fprintf(stderr, "%s: failed %d missing %d duplicated %d "
+			"disorder %d stalled %d free %zu\n", test, failed, missing,
+			duplicated, shared.disorder_.load(), shared.stalled_.load(),
+			free);
+	}
+	munmap(memory, sizeof(Shared));
+	return ok;
+}
+
+int main()
+{
+	const bool ok(run<ShmQueue<Record, 16> >("owner churn", 256, 500)
+		&& run<ShmQueue<Record> >("long-lived owners", 100, 0));
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// size() walks the nodes and must be exact while the queue is quiescent;
+// under traffic it must stay between zero and the pushed total and never
+// touch a reclaimed node. sizeApprox() and isEmpty() must agree with it
+// once the traffic stops.
+using Queue = LockFreeQueue<int, 16, 64>;
+
+const int PRODUCERS = 2;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 100000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+bool quiescent()
+{
+	Queue queue;
+	bool ok(queue.isEmpty() && !queue.size() && !queue.sizeApprox());
+	for (int i = 0; i < 1000; ++i)
+	{
+		queue.push(i);
+	}
+	ok = ok && !queue.isEmpty() && queue.size() == 1000
+		&& queue.sizeApprox() == 1000;
+	int value;
+	for (int i = 0; i < 400; ++i)
+	{
+		queue.pop(value);
+	}
+	ok = ok && queue.size() == 600 && queue.sizeApprox() == 600;
+	Queue::Chained chain;
+	ok = ok && queue.drain(chain) == 600 && queue.isEmpty()
+		&& !queue.size() && !queue.sizeApprox();
+	Queue::Node* node(chain.moveHead());
+	Queue::Node* const tail(chain.moveTail());
+	while (node)
+	{
+		Queue::Node* const next(node == tail
+			? nullptr : node->next_.load(std::memory_order_relaxed));
+		Reclaim<Queue::Node, Queue::NodeAllocator>(node);
+		node = next;
+	}
+	Queue::ReclaimHazardNodes();
+	if (!ok)
+	{
+		fprintf(stderr, "quiescent size mismatch\n");
+	}
+	return ok;
+}
+
+bool traffic()
+{
+	Queue queue;
+	std::atomic<int> taken(0);
+	std::atomic<int> outOfRange(0);
+	std::atomic<int> samples(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			int value;
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					++taken;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			Queue::ReclaimLocalHazardNodes();
+		});
+	}
+	threads.emplace_back([&]() {
+		while (taken.load() < TOTAL)
+		{
+			if (queue.size() > size_t(TOTAL))
+			{
+				++outOfRange;
+			}
+			++samples;
+			std::this_thread::yield();
+		}
+	});
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	const bool empty(queue.isEmpty() && !queue.size()
+		&& !queue.sizeApprox());
+	Queue::ReclaimHazardNodes();
+	if (outOfRange.load() || !samples.load() || !empty)
+	{
+		fprintf(stderr, "out of range %d samples %d empty %d\n",
+			outOfRange.load(), samples.load(), empty);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(quiescent() && traffic());
+	return ok ? 0 : 1;
+}
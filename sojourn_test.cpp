@@ -0,0 +1,196 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SojournQueue.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Histogram buckets must cover every value within 1/16 of it, percentiles
+// and merges must add up, and SojournQueue must record one sojourn per pop
+// that is at least as long as the element really waited.
+using Queue = SojournQueue<int, 8, 64>;
+
+const int PRODUCERS = 2;
+const int CONSUMERS = 2;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+const int WAIT_MS = 20;
+
+bool buckets()
+{
+	bool ok(true);
+	for (uint64_t value = 1; value < UINT64_MAX / 2 && ok;
+		value += value / 7 + 1)
+	{
+		const size_t bucket(LatencyHistogram::BucketOf(value));
+		const uint64_t lower(LatencyHistogram::LowerBound(bucket));
+		const uint64_t upper(LatencyHistogram::UpperBound(bucket));
+		ok = bucket < LatencyHistogram::BUCKETS
+			&& lower <= value && value <= upper
+			&& upper - lower <= value / LatencyHistogram::SUB_BUCKETS;
+	}
+	ok = ok && LatencyHistogram::BucketOf(UINT64_MAX)
+		== LatencyHistogram::BUCKETS - 1;
+	LatencyHistogram first;
+	LatencyHistogram second;
+	for (uint64_t value = 1; value <= 100; ++value)
+	{
+		(value % 2 ? first : second).record(value * 1000);
+	}
+	first.merge(second);
+	const uint64_t median(first.valueAtPercentile(50));
+	ok = ok && first.count() == 100 && median >= 50000
+		&& median <= 50000 + 50000 / LatencyHistogram::SUB_BUCKETS
+		&& first.valueAtPercentile(100) >= 100000
+		&& !LatencyHistogram().valueAtPercentile(99);
+	if (!ok)
+	{
+		fprintf(stderr, "histogram buckets or percentiles wrong\n");
+	}
+	return ok;
+}
+
+bool waited()
+{
+	Queue queue;
+	for (int i = 0; i < 100; ++i)
+	{
+		queue.push(i);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(WAIT_MS));
+	int value(0);
+	bool ok(true);
+	for (int i = 0; i < 100; ++i)
+	{
+		ok = ok && queue.pop(value) && value == i;
+	}
+	LatencyHistogram histogram;
+	queue.snapshot(histogram);
+	const double fastest(SojournClock::ToNanoseconds(
+		LatencyHistogram::LowerBound(
+			LatencyHistogram::BucketOf(histogram.valueAtPercentile(0)))));
+	Queue::ReclaimLocalHazardNodes();
+	// Allow for the TSC calibration being a few percent off.
+	if (!ok || histogram.count() != 100 || fastest < WAIT_MS * 0.8e6)
+	{
+		fprintf(stderr, "waited: count %llu fastest %.0f ns\n",
+			static_cast<unsigned long long>(histogram.count()), fastest);
+		return false;
+	}
+	return true;
+}
+
+bool concurrent()
+{
+	Queue queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> taken(0);
+	std::vector<std::thread> threads;
+	for (int p = 0; p < PRODUCERS; ++p)
+	{
+		threads.emplace_back([&queue, p]() {
+			for (int i = 0; i < PER_PRODUCER; ++i)
+			{
+				queue.push(p * PER_PRODUCER + i);
+			}
+		});
+	}
+	for (int c = 0; c < CONSUMERS; ++c)
+	{
+		threads.emplace_back([&]() {
+			int value(0);
+			while (taken.load() < TOTAL)
+			{
+				if (queue.pop(value))
+				{
+					++seen[value];
+					++taken;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+			Queue::ReclaimLocalHazardNodes();
+		});
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() != 1;
+	}
+	LatencyHistogram histogram;
+	queue.snapshot(histogram);
+	LatencyHistogram twice;
+	queue.snapshot(twice);
+	queue.snapshot(twice);
+	if (missing || histogram.count() != uint64_t(TOTAL)
+		|| twice.count() != 2 * histogram.count() || !queue.isEmpty())
+	{
+		fprintf(stderr, "missing %d recorded %llu\n", missing,
+			static_cast<unsigned long long>(histogram.count()));
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool ok(buckets() && waited() && concurrent());
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SpillQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Producers run well ahead of a slow consumer, so records cross from the
+// in-memory queue into the spill log and back several times; each
+// producer's records must still come out in order, exactly once. A
+// thread feeding several queues must keep each of them under its threshold.
+struct Record
+{
+	int producer_;
+	int sequence_;
+};
+
+using Queue = SpillQueue<Record, 8, 64>;
+
+const size_t THRESHOLD = 1000;
+const int PER_PRODUCER = 200000;
+
+bool run(const std::string& directory, int producers)
+{
+	Queue queue(directory, THRESHOLD, 1 << 20);
+	const int total(producers * PER_PRODUCER);
+	std::vector<int> last(producers, -1);
+	int disorder(0);
+	int popped(0);
+	size_t spilled(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < producers; ++i)
+	{
+		threads.emplace_back([&queue, i]()
+			{
+				for (int j = 0; j < PER_PRODUCER; ++j)
+				{
+					while (!queue.push(Record{ i, j }))
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+	}
+	Record record;
+	while (popped < total)
+	{
+		if (!queue.pop(record))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if (popped % 64 == 0)
+		{
+			const size_t now(queue.spilled());
+			spilled = now > spilled ? now : spilled;
+		}
+		++popped;
+		if (record.sequence_ != last[record.producer_] + 1)
+		{
+			++disorder;
+		}
+		last[record.producer_] = record.sequence_;
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	const bool empty(!queue.pop(record) && queue.isEmpty());
+	Queue::ReclaimHazardNodes();
+	if (disorder || !empty || !spilled)
+	{
+		fprintf(stderr, "%d producers: disorder %d empty %d spilled %zu\n",
+			producers, disorder, empty, spilled);
+		return false;
+	}
+	return true;
+}
+
+// One thread pushes to a backlogged queue and to a queue it keeps
+// drained, in turn. With threshold 16 the depth is sampled every second
+// push, which a count shared by both queues would always spend on the
+// drained one.
+bool alternate(const std::string& directory)
+{
+	const size_t threshold(16);
+	const int pushes(10000);
+	Queue backlog(directory, threshold, 1 << 20);
+	Queue drained(directory, threshold, 1 << 20);
+	Record record;
+	for (int i = 0; i < pushes; ++i)
+	{
+		backlog.push(Record{ 0, i });
+		drained.push(Record{ 1, i });
+		drained.pop(record);
+	}
+	const size_t spilled(backlog.spilled());
+	int disorder(0);
+	int last(-1);
+	while (backlog.pop(record))
+	{
+		disorder += record.sequence_ != last + 1;
+		last = record.sequence_;
+	}
+	disorder += last != pushes - 1;
+	Queue::ReclaimHazardNodes();
+	if (disorder || spilled < pushes - threshold * 2)
+	{
+		fprintf(stderr, "alternate: disorder %d spilled %zu\n",
+			disorder, spilled);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const char* const tmp(getenv("TMPDIR"));
+	const std::string directory(tmp && *tmp ? tmp : "/tmp");
+	const bool single(run(directory, 1));
+	const bool multiple(run(directory, 3));
+	const bool alternating(alternate(directory));
+	return single && multiple && alternating ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/* BSD 2-Clause License
+
+
+
+Copyright (c) 2020, yoo.huang_@outlook.com
+
+All rights reserved.
+
+
+
+Redistribution and use in source and binary forms, with or without
+
+modification, are permitted provided that the following conditions are met:
+
+
+
+1. Redistributions of source code must retain the above copyright notice, this
+
+   list of conditions and the following disclaimer.
+
+
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+
+   this list of conditions and the following disclaimer in the documentation
+
+   and/or other materials provided with the distribution.
+
+
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WaitFreeQueue.h"
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Runs every operation down the helping path, then the default mix.
+using SlowQueue = WaitFreeQueue<int, 16, 64, std::allocator<int>, 0>;
+using FastQueue = WaitFreeQueue<int, 16, 64>;
+
+const int PRODUCERS = 4;
+const int CONSUMERS = 4;
+const int PER_PRODUCER = 50000;
+const int TOTAL = PRODUCERS * PER_PRODUCER;
+
+template<typename Queue>
+void push(Queue& queue, int producer)
+{
+	for (int i = 0; i < PER_PRODUCER; ++i)
+	{
+		queue.push(producer * PER_PRODUCER + i);
+	}
+}
+
+template<typename Queue>
+void pop(Queue& queue, std::vector<std::atomic<int> >& seen,
+	std::atomic<int>& popped, std::atomic<int>& disorder)
+{
+	int last[PRODUCERS];
+	for (int i = 0; i < PRODUCERS; ++i)
+	{
+		last[i] = -1;
+	}
+	int value;
+	while (popped.load() < TOTAL)
+	{
+		if (!queue.pop(value))
+		{
+			continue;
+		}
+		++popped;
+		++seen[value];
+		const int producer(value / PER_PRODUCER);
+		if (value <= last[producer])
+		{
+			++disorder;
+		}
+		last[producer] = value;
+	}
+	Queue::ReclaimLocalHazardNodes();
+}
+
+template<typename Queue>
+bool run(const char* name)
+{
+	Queue queue;
+	std::vector<std::atomic<int> > seen(TOTAL);
+	std::atomic<int> popped(0);
+	std::atomic<int> disorder(0);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < PRODUCERS; ++i)
+	{
+		threads.emplace_back([&queue, i]() { push(queue, i); });
+	}
+	for (int i = 0; i < CONSUMERS; ++i)
+	{
+		threads.emplace_back([&]() { pop(queue, seen, popped, disorder); });
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	int missing(0);
+	int duplicated(0);
+	for (const auto& count : seen)
+	{
+		missing += count.load() == 0;
+		duplicated += count.load() > 1;
+	}
+	int value;
+	const bool empty(!queue.pop(value) && queue.isEmpty());
+	Queue::ReclaimHazardNodes();
+	if (missing || duplicated || disorder.load() || !empty)
+	{
+		fprintf(stderr, "%s: missing %d duplicated %d disorder %d empty %d\n",
+			name, missing, duplicated, disorder.load(), empty);
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const bool slow(run<SlowQueue>("slow path"));
+	const bool fast(run<FastQueue>("fast path"));
+	return slow && fast ? 0 : 1;
+}